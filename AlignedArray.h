@@ -0,0 +1,85 @@
+#ifndef ALIGNED_ARRAY_H
+#define ALIGNED_ARRAY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Size of a host cache line; simulator metadata is aligned to it
+constexpr std::size_t kCacheLineBytes = 64;
+
+// Asks the host to start loading the cache line holding p; a hint only
+inline void prefetchLine(const void *p)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+// Fixed-size array allocated on a cache-line boundary
+template <typename T>
+class AlignedArray
+{
+private:
+    struct Deleter
+    {
+        void operator()(T *p) const
+        {
+            ::operator delete[](p, std::align_val_t(kCacheLineBytes));
+        }
+    };
+
+    std::unique_ptr<T[], Deleter> data;
+    std::size_t count = 0;
+
+public:
+    AlignedArray() = default;
+
+    explicit AlignedArray(std::size_t count) : count(count)
+    {
+        // Round the allocation up to whole cache lines
+        std::size_t bytes = (count * sizeof(T) + kCacheLineBytes - 1) / kCacheLineBytes * kCacheLineBytes;
+        data.reset(static_cast<T *>(::operator new[](bytes, std::align_val_t(kCacheLineBytes))));
+    }
+
+    // Copies are deep, byte for byte, elements never written included
+    AlignedArray(const AlignedArray &other) : AlignedArray(other.count)
+    {
+        if (count > 0)
+            std::memcpy(static_cast<void *>(data.get()), other.data.get(), count * sizeof(T));
+    }
+
+    AlignedArray &operator=(const AlignedArray &other)
+    {
+        if (this == &other)
+            return *this;
+        if (count != other.count)
+            *this = AlignedArray(other.count);
+        if (count > 0)
+            std::memcpy(static_cast<void *>(data.get()), other.data.get(), count * sizeof(T));
+        return *this;
+    }
+
+    AlignedArray(AlignedArray &&) = default;
+    AlignedArray &operator=(AlignedArray &&) = default;
+
+    T &operator[](std::size_t i) { return data[i]; }
+    const T &operator[](std::size_t i) const { return data[i]; }
+    T *get() { return data.get(); }
+    const T *get() const { return data.get(); }
+    std::size_t length() const { return count; }
+
+    void fill(const T &value) { std::fill(data.get(), data.get() + count, value); }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef BLOCK_RUNS_H
+#define BLOCK_RUNS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Same-block run coalescing. Consecutive accesses to one block collapse
+// into a (block, count) record: the first access of a run may miss, but
+// every later one hits the way the first left the block in, so a cache
+// needs only one tag lookup per record. Records depend on the block size
+// alone, so every cache with that block size can share them.
+
+// A trace as runs of accesses to one block, for one block size
+struct BlockRuns
+{
+    std::vector<std::uint64_t> blocks; // block number of each run
+    std::vector<std::uint32_t> counts; // accesses in each run, at least one
+    std::size_t accesses = 0;          // sum of the counts
+
+    std::size_t size() const { return blocks.size(); }
+
+    void clear()
+    {
+        blocks.clear();
+        counts.clear();
+        accesses = 0;
+    }
+};
+
+// Accesses per record from which simulating the records beats simulating
+// every address; on traces without runs the coalescing is wasted work
+constexpr std::size_t kMinRunLength = 2;
+
+// Replaces `runs` with the runs of `count` addresses, with the same block
+// numbers as Cache::access computes. Gives up and returns false once there
+// are too many runs to average kMinRunLength, which on a trace without
+// runs happens halfway through.
+template <typename T>
+bool coalesceRuns(const T *addresses, std::size_t count, int block_size, BlockRuns &runs)
+{
+    runs.clear();
+    if (count < kMinRunLength || block_size <= 0)
+        return false;
+
+    const std::size_t maxRuns = count / kMinRunLength;
+    runs.blocks.reserve(maxRuns);
+    runs.counts.reserve(maxRuns);
+
+    int shift = 0;
+    while ((1 << shift) < block_size)
+        ++shift;
+    const bool powerOfTwo = (1 << shift) == block_size;
+    const std::uint64_t divisor = static_cast<std::uint64_t>(block_size);
+    auto blockOf = [&](std::size_t i)
+    {
+        std::uint64_t address = static_cast<std::uint64_t>(addresses[i]);
+        return powerOfTwo ? address >> shift : address / divisor;
+    };
+
+    std::uint64_t current = blockOf(0);
+    std::uint32_t length = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::uint64_t block = blockOf(i);
+        if (block != current || length == std::numeric_limits<std::uint32_t>::max())
+        {
+            if (runs.size() + 1 >= maxRuns)
+            {
+                runs.clear();
+                return false;
+            }
+            runs.blocks.push_back(current);
+            runs.counts.push_back(length);
+            current = block;
+            length = 0;
+        }
+        ++length;
+    }
+    runs.blocks.push_back(current);
+    runs.counts.push_back(length);
+    runs.accesses = count;
+    return true;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef BLOCK_STREAM_H
+#define BLOCK_STREAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// A trace as block numbers for one block size, computed once and shared
+// read-only by every cache with that block size, so none of them divides
+// an address again. Block numbers are stored in 32 bits when all of them
+// fit, which halves the memory the caches stream through.
+struct BlockStream
+{
+    std::vector<std::uint32_t> narrow; // every block number, when they fit in 32 bits
+    std::vector<std::uint64_t> wide;   // every block number, otherwise
+
+    bool isNarrow() const { return wide.empty(); }
+    std::size_t size() const { return isNarrow() ? narrow.size() : wide.size(); }
+};
+
+// Block numbers of `count` addresses, the same as Cache::access computes
+template <typename T>
+BlockStream blockStream(const T *addresses, std::size_t count, int block_size)
+{
+    BlockStream stream;
+    if (count == 0 || block_size <= 0)
+        return stream;
+
+    int shift = 0;
+    while ((1 << shift) < block_size)
+        ++shift;
+    const bool powerOfTwo = (1 << shift) == block_size;
+    const std::uint64_t divisor = static_cast<std::uint64_t>(block_size);
+    auto blockOf = [&](std::uint64_t address)
+    { return powerOfTwo ? address >> shift : address / divisor; };
+
+    const std::uint64_t maxBlock = blockOf(static_cast<std::uint64_t>(*std::max_element(addresses, addresses + count)));
+    if (maxBlock <= std::numeric_limits<std::uint32_t>::max())
+    {
+        stream.narrow.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+            stream.narrow[i] = static_cast<std::uint32_t>(blockOf(static_cast<std::uint64_t>(addresses[i])));
+    }
+    else
+    {
+        stream.wide.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+            stream.wide[i] = blockOf(static_cast<std::uint64_t>(addresses[i]));
+    }
+    return stream;
+}
+
+#endif
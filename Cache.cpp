@@ -5,200 +5,676 @@
 #include <unordered_map>
 #include <istream>
 #include <string>
-
-class Cache
+#include <cstdint>
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+
+#include "BlockRuns.h"
+#include "Cache.h"
+#include "CacheHierarchy.h"
+#include "CacheKernel.h"
+#include "PassReplay.h"
+#include "Report.h"
+#include "SegmentedRun.h"
+#include "ShardedCache.h"
+#include "StackDistance.h"
+#include "Sweep.h"
+#include "Trace.h"
+#include "TraceFilter.h"
+#include "TraceSource.h"
+
+// Runs the filtered trace through the cache once
+template <typename Policy>
+void runPass(Cache<Policy> &cache, const TraceSource &source, std::uint64_t &hits, std::uint64_t &accesses)
 {
-private:
-    // Define cache parameters
-    int size; // in bytes
-    int associativity;
-    int block_size;
-    int sets;
-    std::vector<std::vector<bool>> valid;      // Valid bit for each block in each set
-    std::vector<std::vector<int>> lru_counter; // LRU counter for each block in each set
+    source.replayRuns([&](const Address *addresses, std::size_t count, const BlockRuns *runs)
+                      {
+        // check for hit on read or write, a same-block run at a time where
+        // the source coalesced the piece
+        hits += runs != nullptr ? accessRuns(cache, *runs) : accessAll(cache, addresses, count);
+        accesses += count;
+        return true; });
+}
 
-public:
-    Cache(int size, int associativity, int block_size) : size(size), associativity(associativity), block_size(block_size)
+// Adds the banner and the statistics of every pass to the report. Two
+// passes are the first and second runs of the original report; more also
+// get the totals and the number of passes simulated before the cache
+// reached a fixed point.
+void reportPasses(Report &report, const std::vector<PassStats> &passes, std::size_t simulated)
+{
+    // Startup banner
+    report.addBanner("SER450 - Project 5");
+    report.addBanner("Akhil Matthews");
+    report.addBanner("--------------------------------");
+
+    // Hit rate for every pass
+    PassStats total;
+    for (std::size_t pass = 0; pass < passes.size(); ++pass)
     {
-        // Calculate the number of sets
-        sets = size / (associativity * block_size);
-
-        // Initialize cache state
-        valid.assign(sets, std::vector<bool>(associativity, false));
-        lru_counter.assign(sets, std::vector<int>(associativity, 0));
+        std::string label = passes.size() == 2 ? (pass == 0 ? "First Run" : "Second Run") : "Pass " + std::to_string(pass + 1);
+        report.line(label).field("Hits", passes[pass].hits).field("Accesses", passes[pass].accesses);
+        report.line(label).field("Hit Rate", passes[pass].hitRate());
+        total.hits += passes[pass].hits;
+        total.accesses += passes[pass].accesses;
     }
+    if (passes.size() == 2)
+        return;
 
-    bool access(int address)
-    {
-        // Simulate cache behavior for the given address
-        int set_index = (address / block_size) % sets;
-        int block_offset = address % block_size;
+    report.line("All Passes").field("Hits", total.hits).field("Accesses", total.accesses).field("Hit Rate", total.hitRate());
+    report.line("").field("Passes", passes.size()).field("Simulated Passes", simulated);
+}
+
+// The two runs of a segmented simulation as passes
+void reportRuns(Report &report, const SweepResult &result)
+{
+    std::vector<PassStats> passes(2);
+    passes[0].hits = result.hits1;
+    passes[0].accesses = result.accesses1;
+    passes[1].hits = result.hits2;
+    passes[1].accesses = result.accesses2;
+    reportPasses(report, passes, 2);
+}
 
-        // Check if the block is in the cache
-        for (int i = 0; i < associativity; ++i)
+// Simulates one configuration for `passes` passes, split by set across
+// `threads` threads when the policy keeps no state shared between sets.
+// Passes after the cache reaches a fixed point are extrapolated.
+template <typename Policy>
+void simulate(Report &report, const TraceSource &source, int cache_size, int associativity, int block_size, std::uint64_t seed,
+              unsigned threads, std::size_t passes)
+{
+    std::size_t simulated = 0;
+    if constexpr (Policy::kSetLocal)
+    {
+        if (threads > 1)
         {
-            if (valid[set_index][i] && lru_counter[set_index][i] == 0)
-            {
-                // Cache hit
-                updateLRU(set_index, i);
-                return true;
-            }
+            ShardedCache<Policy> cache(cache_size, associativity, block_size, threads, seed);
+            std::vector<Cache<Policy>> previous;
+            std::vector<PassStats> stats = runPasses(
+                passes, [&](std::uint64_t &hits, std::uint64_t &accesses)
+                { cache.runPass(source, hits, accesses); },
+                [&]()
+                {
+                    bool same = !previous.empty() && cache.sameState(previous);
+                    previous = cache.snapshot();
+                    return same;
+                },
+                simulated);
+            reportPasses(report, stats, simulated);
+            return;
         }
+    }
+    else if (threads > 1)
+    {
+        std::cerr << "Note: this policy shares state between sets; simulating on one thread" << std::endl;
+    }
 
-        // Cache miss
-        int victim_index = findLRUVictim(set_index);
-        valid[set_index][victim_index] = true;
-        updateLRU(set_index, victim_index);
-        return false;
+    Cache<Policy> cache(cache_size, associativity, block_size, seed);
+    std::optional<Cache<Policy>> previous;
+    std::vector<PassStats> stats = runPasses(
+        passes, [&](std::uint64_t &hits, std::uint64_t &accesses)
+        { runPass(cache, source, hits, accesses); },
+        [&]()
+        {
+            bool same = previous && cache.sameState(*previous);
+            previous = cache;
+            return same;
+        },
+        simulated);
+    reportPasses(report, stats, simulated);
+}
+
+// Simulates the upper levels in front of the configured cache as one
+// hierarchy for `passes` passes. The runs count an access as a hit when
+// any level holds it; every level's own statistics and the traffic between
+// levels are totals over all passes.
+template <typename Policy>
+void simulateHierarchy(Report &report, const TraceSource &source, const std::vector<LevelConfig> &configs, int block_size, Inclusion inclusion,
+                       std::uint64_t seed, std::size_t passes)
+{
+    CacheHierarchy<Policy> hierarchy(configs, block_size, inclusion, seed);
+    std::optional<CacheHierarchy<Policy>> previous;
+    std::vector<std::vector<LevelStats>> levelStats;
+    std::size_t simulated = 0;
+    std::vector<PassStats> stats = runPasses(
+        passes, [&](std::uint64_t &hits, std::uint64_t &accesses)
+        {
+            hierarchy.runPass(source, hits, accesses);
+            levelStats.push_back(hierarchy.takeStats()); },
+        [&]()
+        {
+            bool same = previous && hierarchy.sameState(*previous);
+            previous = hierarchy;
+            return same;
+        },
+        simulated);
+    reportPasses(report, stats, simulated);
+
+    // Extrapolated passes repeat the last simulated one
+    std::vector<LevelStats> total(hierarchy.depth());
+    for (std::size_t pass = 0; pass < passes; ++pass)
+    {
+        const std::vector<LevelStats> &counted = levelStats[std::min(pass, simulated - 1)];
+        for (std::size_t i = 0; i < total.size(); ++i)
+            total[i] += counted[i];
     }
 
-    void resetCacheState()
+    report.line("Hierarchy").field("Levels", total.size()).field("Inclusion", std::string(inclusionName(hierarchy.getInclusion())));
+    for (std::size_t i = 0; i < total.size(); ++i)
     {
-        // Reset the cache state for the next run
-        valid.assign(sets, std::vector<bool>(associativity, false));
-        lru_counter.assign(sets, std::vector<int>(associativity, 0));
+        std::string name = "L" + std::to_string(i + 1);
+        report.line(name)
+            .field("Accesses", total[i].accesses)
+            .field("Hits", total[i].hits)
+            .field("Hit Rate", total[i].hitRate())
+            .field("Fills", total[i].fills)
+            .field("Evictions", total[i].evictions)
+            .field("Back-Invalidations", total[i].back_invalidations);
     }
+    for (std::size_t i = 0; i < total.size(); ++i)
+    {
+        std::string below = i + 1 < total.size() ? "L" + std::to_string(i + 2) : "Memory";
+        report.line("L" + std::to_string(i + 1) + "-" + below + " Traffic").field("Requests", total[i].misses()).field("Victims", total[i].victims);
+    }
+}
 
-private:
-    void updateLRU(int set_index, int used_index)
+// Simulates one configuration as time segments run in parallel, and with
+// verify also serially to measure the error of the segmentation
+template <typename Policy>
+void simulateSegments(Report &report, const Trace &trace, std::size_t length, const SweepConfig &config, std::size_t segments, std::size_t warmup, bool verify,
+                      unsigned threads, std::uint64_t seed)
+{
+    std::vector<SweepResult> parts = runSegments<Policy>(trace.data(), length, config, segments, warmup, threads, seed);
+    reportRuns(report, combineSegments(parts));
+    report.line("").field("Segments", parts.size()).field("Warm-up Accesses", warmup);
+    if (!verify)
+        return;
+
+    std::vector<SweepResult> exact = serialSegments<Policy>(trace.data(), length, config, segments, seed);
+    SweepResult serial = combineSegments(exact);
+    SweepResult parallel = combineSegments(parts);
+    report.line("Serial First Run")
+        .field("Hits", serial.hits1)
+        .field("Error", static_cast<std::int64_t>(parallel.hits1) - static_cast<std::int64_t>(serial.hits1))
+        .field("Hit Rate Error", parallel.hitRate1() - serial.hitRate1());
+    report.line("Serial Second Run")
+        .field("Hits", serial.hits2)
+        .field("Error", static_cast<std::int64_t>(parallel.hits2) - static_cast<std::int64_t>(serial.hits2))
+        .field("Hit Rate Error", parallel.hitRate2() - serial.hitRate2());
+
+    // Largest miscount of any single segment
+    std::size_t worst = 0;
+    std::int64_t worstError = 0;
+    for (std::size_t k = 0; k < parts.size(); ++k)
     {
-        // Update LRU counters based on the accessed block
-        for (int i = 0; i < associativity; ++i)
+        std::int64_t error = static_cast<std::int64_t>(parts[k].hits1 + parts[k].hits2) - static_cast<std::int64_t>(exact[k].hits1 + exact[k].hits2);
+        if (std::llabs(error) > std::llabs(worstError))
         {
-            if (valid[set_index][i] && i != used_index)
-            {
-                lru_counter[set_index][i]++;
-            }
+            worst = k;
+            worstError = error;
         }
-        lru_counter[set_index][used_index] = 0;
     }
+    report.line("Worst Segment").field("Index", worst).field("Error", worstError).field("Accesses", parts[worst].accesses1 + parts[worst].accesses2);
+}
 
-    int findLRUVictim(int set_index)
-    {
-        // Find the index of the block with the highest LRU counter
-        int max_lru = -1;
-        int victim_index = 0;
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <input_file> <cache_size> <associativity> <block_size> <upper_bound> [options]" << std::endl;
+    std::cerr << "Addresses above <upper_bound> are left out of the runs." << std::endl;
+    std::cerr << "       " << program << " --sweep <input_file> [options]" << std::endl;
+    std::cerr << "<input_file> may be - for standard input, or a FIFO" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --policy <name>       replacement policy: lru (default), fifo, random, plru," << std::endl;
+    std::cerr << "                        bitplru, lfu, srrip, brrip, drrip" << std::endl;
+    std::cerr << "  --seed <n>            seed for the randomized policies (default 1)" << std::endl;
+    std::cerr << "  --threads <n>         worker threads; a single configuration is split by set" << std::endl;
+    std::cerr << "                        (default: 1, or all cores for a sweep)" << std::endl;
+    std::cerr << "  --segments <n>        cut the two runs into n time segments simulated in parallel" << std::endl;
+    std::cerr << "  --warmup <n>          uncounted accesses replayed before each segment" << std::endl;
+    std::cerr << "                        (default: four times the blocks in the cache)" << std::endl;
+    std::cerr << "  --verify              also simulate serially and report the segmentation error" << std::endl;
+    std::cerr << "  --include <lo-hi>     simulate only addresses in this range; repeatable" << std::endl;
+    std::cerr << "  --exclude <lo-hi>     leave out addresses in this range; repeatable" << std::endl;
+    std::cerr << "                        (addresses are decimal, or hexadecimal after 0x)" << std::endl;
+    std::cerr << "  --skip <n>            leave out the first n accesses of the trace" << std::endl;
+    std::cerr << "  --limit <n>           simulate at most n accesses per run" << std::endl;
+    std::cerr << "  --sample <n>          simulate one access in every n that pass the ranges" << std::endl;
+    std::cerr << "  --format <name>       summary as human (default), csv or json" << std::endl;
+    std::cerr << "  --passes <n>          replay the trace n times without resetting the cache" << std::endl;
+    std::cerr << "                        (default 2); passes after a fixed point are extrapolated" << std::endl;
+    std::cerr << "  --spill <file>        keep a streamed text trace for the second run in this" << std::endl;
+    std::cerr << "                        packed trace file instead of in memory" << std::endl;
+    std::cerr << "  --upper-levels <list> size:associativity of each cache in front of the one" << std::endl;
+    std::cerr << "                        given, nearest the core first (e.g. 32768:8,262144:8);" << std::endl;
+    std::cerr << "                        the runs then count hits in any level" << std::endl;
+    std::cerr << "  --inclusion <name>    how the last level relates to the upper levels: nine" << std::endl;
+    std::cerr << "                        (default), inclusive or exclusive" << std::endl;
+    std::cerr << "Sweep options:" << std::endl;
+    std::cerr << "  --sizes <list>        cache sizes in bytes (default 2048,4096,8192,16384,32768)" << std::endl;
+    std::cerr << "  --ways <list>         associativities (default 1,2,4,8)" << std::endl;
+    std::cerr << "  --blocks <list>       block sizes in bytes (default 4,8,16,32,64)" << std::endl;
+    std::cerr << "  --assoc-block <n>     block size of the by-associativity table (default: largest)" << std::endl;
+    std::cerr << "  --block-ways <n>      associativity of the by-block-size table (default: 4 if swept)" << std::endl;
+    std::cerr << "  --upper-bound <n>     leave out addresses above n" << std::endl;
+    std::cerr << "  --out <prefix>        output file prefix (default: input file name without extension)" << std::endl;
+    std::cerr << "  --order <name>        config (each configuration over the whole trace, default)" << std::endl;
+    std::cerr << "                        or chunk (every configuration over each trace chunk)" << std::endl;
+    std::cerr << "  --stack-distance      derive LRU results from one stack-distance pass per" << std::endl;
+    std::cerr << "                        block size and set count instead of simulating" << std::endl;
+}
 
-        for (int i = 0; i < associativity; ++i)
-        {
-            if (!valid[set_index][i])
-            {
-                // Found an invalid block, use it as a victim
-                return i;
-            }
+// Parses a comma-separated list of positive integers
+std::vector<int> parseIntList(const std::string &text)
+{
+    std::vector<int> values;
+    std::size_t start = 0;
+    while (start <= text.size())
+    {
+        std::size_t comma = text.find(',', start);
+        if (comma == std::string::npos)
+            comma = text.size();
+        int value = std::stoi(text.substr(start, comma - start));
+        if (value <= 0)
+            throw std::invalid_argument("values must be positive");
+        values.push_back(value);
+        start = comma + 1;
+    }
+    return values;
+}
 
-            if (lru_counter[set_index][i] > max_lru)
-            {
-                max_lru = lru_counter[set_index][i];
-                victim_index = i;
-            }
-        }
+// Parses a count of at least `least`; stoull would wrap a negative one
+// around
+std::uint64_t parseCount(const std::string &text, std::uint64_t least = 1)
+{
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+        throw std::invalid_argument("expected an unsigned whole number");
+    std::size_t end;
+    std::uint64_t value = std::stoull(text, &end);
+    if (end != text.size())
+        throw std::invalid_argument("expected an unsigned whole number");
+    if (value < least)
+        throw std::invalid_argument("must be at least " + std::to_string(least));
+    return value;
+}
 
-        return victim_index;
+// Parses a comma-separated list of size:associativity pairs
+std::vector<LevelConfig> parseLevelList(const std::string &text)
+{
+    std::vector<LevelConfig> levels;
+    std::size_t start = 0;
+    while (start <= text.size())
+    {
+        std::size_t comma = text.find(',', start);
+        if (comma == std::string::npos)
+            comma = text.size();
+        std::string level = text.substr(start, comma - start);
+        std::size_t colon = level.find(':');
+        if (colon == std::string::npos)
+            throw std::invalid_argument("level '" + level + "' is not size:associativity");
+        levels.push_back(LevelConfig{std::stoi(level.substr(0, colon)), std::stoi(level.substr(colon + 1))});
+        start = comma + 1;
     }
+    return levels;
+}
+
+// Command-line settings shared by the single-configuration and sweep modes
+struct Options
+{
+    std::vector<std::string> positional;
+    PolicyKind policy = PolicyKind::Lru;
+    std::uint64_t seed = 1;
+    ReportFormat format = ReportFormat::Human;
+    std::string spill;
+    std::size_t passes = 2;
+    TraceFilter filter;
+    std::vector<LevelConfig> upper_levels;
+    Inclusion inclusion = Inclusion::Nine;
+
+    bool sweep = false;
+    bool stack_distance = false;
+    std::vector<int> sizes = {2048, 4096, 8192, 16384, 32768};
+    std::vector<int> ways = {1, 2, 4, 8};
+    std::vector<int> blocks = {4, 8, 16, 32, 64};
+    int assoc_block = 0;
+    int block_ways = 0;
+    Address upper_bound = ~static_cast<Address>(0);
+    unsigned threads = 0;
+    std::string out;
+    SweepOrder order = SweepOrder::ConfigMajor;
+
+    std::size_t segments = 0;
+    std::int64_t warmup = -1;
+    bool verify = false;
 };
 
-int main(int argc, char *argv[])
+// Design-space sweep: loads the trace once and simulates every
+// configuration in parallel, then writes the CSV tables
+int runSweepMode(const Options &options)
 {
-    if (argc != 6)
+    if (options.positional.size() != 1)
+        return -1;
+
+    const std::string &inputFileName = options.positional[0];
+    Trace trace;
+    try
     {
-        std::cerr << "Usage: " << argv[0] << " <input_file> <cache_size> <associativity> <block_size> <upper_bound>" << std::endl;
+        trace = loadTrace(inputFileName);
+    }
+    catch (const TraceError &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
 
-    const char *inputFileName = argv[1];
-    std::ifstream inputFile(inputFileName);
+    TraceFilter filter = options.filter;
+    filter.addUpperBound(options.upper_bound);
+    applyFilter(filter, trace);
+    const std::size_t length = trace.size();
+
+    std::vector<SweepConfig> configs = sweepConfigs(options.sizes, options.ways, options.blocks);
+    unsigned threads = options.threads > 0 ? options.threads : defaultThreadCount();
 
-    if (!inputFile.is_open())
+    std::string prefix = options.out;
+    if (prefix.empty())
     {
-        std::cerr << "Error: Unable to open file " << inputFileName << std::endl;
-        return 1;
+        std::size_t slash = inputFileName.find_last_of("/\\");
+        std::size_t dot = inputFileName.find_last_of('.');
+        prefix = (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? inputFileName.substr(0, dot) : inputFileName;
     }
 
-    // Determine the upper bound dynamically based on the content of the file
-    unsigned long maxAddress = 0;
-    std::string line;
+    int assocBlock = options.assoc_block > 0 ? options.assoc_block : *std::max_element(options.blocks.begin(), options.blocks.end());
+    int blockWays = options.block_ways;
+    if (blockWays <= 0)
+        blockWays = std::find(options.ways.begin(), options.ways.end(), 4) != options.ways.end() ? 4 : options.ways.back();
 
-    while (std::getline(inputFile, line))
+    double seconds = 0.0;
+    try
     {
-        try
+        auto start = std::chrono::steady_clock::now();
+        std::vector<SweepResult> results;
+        if (options.stack_distance)
         {
-            unsigned long currentAddress = std::stoul(line, nullptr, 16);
-            maxAddress = std::max(maxAddress, currentAddress);
+            if (options.policy != PolicyKind::Lru)
+                throw std::invalid_argument("stack distance analysis only models the lru policy");
+            results = runStackDistanceSweep(trace, length, configs, threads);
         }
-        catch (const std::invalid_argument &e)
+        else
         {
-            // Handle invalid address (non-hexadecimal)
-            std::cerr << "Error: Invalid address in the file." << std::endl;
-            return 1;
+            results = withPolicy(options.policy, [&](auto tag)
+                                 { return runSweep<typename decltype(tag)::type>(trace, length, configs, threads, options.seed, options.order); });
         }
-        catch (const std::out_of_range &e)
-        {
-            // Handle out of range address
-            std::cerr << "Error: Address out of range." << std::endl;
-            return 1;
-        }
-    }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    const long upperBound = std::min(maxAddress, std::stoul(argv[5]));
+        writeSweepTable(prefix + "_by_asociativity.csv", configs, results, options.sizes, options.ways, true, assocBlock);
+        writeSweepTable(prefix + "_by_blocksize.csv", configs, results, options.sizes, options.blocks, false, blockWays);
+        writeSweepList(prefix + "_sweep.csv", configs, results);
+    }
+    catch (const std::logic_error &e)
+    {
+        std::cerr << "Error: " << e.what() << "." << std::endl;
+        return 1;
+    }
+    catch (const TraceError &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
 
-    // Initialize the cache with the desired parameters
-    int cache_size = std::stoi(argv[2]);
-    int associativity = std::stoi(argv[3]);
-    int block_size = std::stoi(argv[4]);
+    Report report;
+    report.line("Sweep").field("Configurations", configs.size()).field("Accesses", length).field("Threads", static_cast<std::uint64_t>(threads)).field("Seconds", seconds);
+    report.line("Wrote")
+        .field("By Associativity", prefix + "_by_asociativity.csv")
+        .field("By Block Size", prefix + "_by_blocksize.csv")
+        .field("List", prefix + "_sweep.csv");
+    report.write(std::cout, options.format);
+    return 0;
+}
 
-    Cache cache(cache_size, associativity, block_size);
+// Time-parallel simulation of one configuration: loads the whole trace so
+// every segment can start anywhere in it
+int runSegmentMode(const Options &options)
+{
+    const std::vector<std::string> &positional = options.positional;
+    Trace trace;
+    try
+    {
+        trace = loadTrace(positional[0]);
+    }
+    catch (const TraceError &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
 
-    unsigned long hits1 = 0;
-    unsigned long accesses1 = 0;
+    Report report;
+    try
+    {
+        TraceFilter filter = options.filter;
+        filter.addUpperBound(std::stoull(positional[4]));
+        applyFilter(filter, trace);
+        const std::size_t length = trace.size();
+
+        SweepConfig config{std::stoi(positional[1]), std::stoi(positional[2]), std::stoi(positional[3])};
+        if (config.block_size <= 0)
+            throw std::invalid_argument("associativity and block size must be positive");
+        std::size_t warmup = options.warmup >= 0 ? static_cast<std::size_t>(options.warmup) : 4 * static_cast<std::size_t>(std::max(config.size / config.block_size, 0));
+        unsigned threads = options.threads > 0 ? options.threads : defaultThreadCount();
+
+        withPolicy(options.policy, [&](auto tag)
+                   { simulateSegments<typename decltype(tag)::type>(report, trace, length, config, options.segments, warmup, options.verify, threads, options.seed); });
+    }
+    catch (const std::logic_error &e)
+    {
+        std::cerr << "Error: " << e.what() << "." << std::endl;
+        return 1;
+    }
 
-    // Reset the file stream to the beginning of the file
-    inputFile.clear();
-    inputFile.seekg(0, std::ios::beg);
+    report.write(std::cout, options.format);
+    return 0;
+}
 
-    unsigned long address;
+int main(int argc, char *argv[])
+{
+    Options options;
 
-    // First run through the patterns
-    while (inputFile >> std::hex >> address && address <= upperBound) // Check against the updated upper bound
+    for (int i = 1; i < argc; ++i)
     {
-        // check for hit on read or write
-        if (cache.access(address))
-            hits1++;
-        accesses1++;
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0)
+        {
+            options.positional.push_back(arg);
+            continue;
+        }
+        if (arg == "--sweep")
+        {
+            options.sweep = true;
+            continue;
+        }
+        if (arg == "--stack-distance")
+        {
+            options.stack_distance = true;
+            continue;
+        }
+        if (arg == "--verify")
+        {
+            options.verify = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        try
+        {
+            std::string value = argv[++i];
+            if (arg == "--policy")
+                options.policy = parsePolicyKind(value);
+            else if (arg == "--format")
+                options.format = parseReportFormat(value);
+            else if (arg == "--include")
+                options.filter.include.push_back(parseAddressRange(value));
+            else if (arg == "--exclude")
+                options.filter.exclude.push_back(parseAddressRange(value));
+            else if (arg == "--skip")
+                options.filter.skip = parseCount(value, 0);
+            else if (arg == "--limit")
+                options.filter.limit = parseCount(value, 0);
+            else if (arg == "--sample")
+                options.filter.sample = parseCount(value);
+            else if (arg == "--passes")
+                options.passes = parseCount(value);
+            else if (arg == "--spill")
+                options.spill = value;
+            else if (arg == "--upper-levels")
+                options.upper_levels = parseLevelList(value);
+            else if (arg == "--inclusion")
+                options.inclusion = parseInclusion(value);
+            else if (arg == "--seed")
+                options.seed = std::stoull(value);
+            else if (arg == "--sizes")
+                options.sizes = parseIntList(value);
+            else if (arg == "--ways")
+                options.ways = parseIntList(value);
+            else if (arg == "--blocks")
+                options.blocks = parseIntList(value);
+            else if (arg == "--assoc-block")
+                options.assoc_block = std::stoi(value);
+            else if (arg == "--block-ways")
+                options.block_ways = std::stoi(value);
+            else if (arg == "--upper-bound")
+                options.upper_bound = std::stoull(value);
+            else if (arg == "--threads")
+                options.threads = static_cast<unsigned>(parseCount(value));
+            else if (arg == "--out")
+                options.out = value;
+            else if (arg == "--order")
+                options.order = parseSweepOrder(value);
+            else if (arg == "--segments")
+                options.segments = parseCount(value);
+            else if (arg == "--warmup")
+                options.warmup = static_cast<std::int64_t>(parseCount(value, 0));
+            else
+            {
+                std::cerr << "Error: Unknown option " << arg << std::endl;
+                return 1;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: Invalid value for " << arg << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
+    // Sweeps and segmented runs report exactly a first and a second run
+    if (options.passes != 2 && (options.sweep || options.segments > 0))
+    {
+        std::cerr << "Error: --passes applies to unsegmented single configurations only" << std::endl;
+        return 1;
+    }
 
+    if (!options.upper_levels.empty() && (options.sweep || options.segments > 0))
+    {
+        std::cerr << "Error: --upper-levels applies to unsegmented single configurations only" << std::endl;
+        return 1;
+    }
+    if (options.upper_levels.empty() && options.inclusion != Inclusion::Nine)
+    {
+        std::cerr << "Error: --inclusion needs --upper-levels" << std::endl;
+        return 1;
+    }
 
-        // Print a startup banner
-        std::cout << "SER450 - Project 5" << std::endl;
-        std::cout << "Akhil Matthews" << std::endl;
-        std::cout << "--------------------------------" << std::endl;
+    if (options.sweep)
+    {
+        int status = runSweepMode(options);
+        if (status < 0)
+            printUsage(argv[0]);
+        return status < 0 ? 1 : status;
+    }
 
-        // Output hit rate for the first run
-        double hitRate1 = (accesses1 > 0) ? static_cast<double>(hits1) / accesses1 : 0.0;
-        std::cout << "First Run - Hits: " << hits1 << ", Accesses: " << accesses1 << std::endl;
-        std::cout << "First Run - Hit Rate: " << hitRate1<< std::endl;
+    const std::vector<std::string> &positional = options.positional;
+    if (positional.size() != 5)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
 
-        // Second run through the patterns without resetting the cache
-        unsigned long hits2 = 0;
-        unsigned long accesses2 = 0;
+    if (options.segments > 0)
+        return runSegmentMode(options);
+
+    // Parse the whole trace once; both runs replay it from memory, or
+    // stream it from the mapped file when it is packed. A text trace on
+    // standard input or a FIFO is simulated as it arrives instead.
+    //
+    // When one cache replays the trace, the source also coalesces it into
+    // same-block runs once, for every pass to share. A bad block size is
+    // reported with the other cache parameters below.
+    const bool setLocal = withPolicy(options.policy, [](auto tag)
+                                     { return decltype(tag)::type::kSetLocal; });
+    int runBlockSize = 0;
+    if (options.upper_levels.empty() && (options.threads <= 1 || !setLocal))
+        runBlockSize = std::atoi(positional[3].c_str());
+
+    std::unique_ptr<TraceSource> source;
+    try
+    {
+        TraceFilter filter = options.filter;
+        filter.addUpperBound(std::stoull(positional[4]));
+        source = std::make_unique<TraceSource>(positional[0], options.spill, static_cast<unsigned>(std::min<std::size_t>(options.passes, 2)), filter, runBlockSize);
+    }
+    catch (const std::logic_error &e)
+    {
+        std::cerr << "Error: Invalid upper bound: " << e.what() << "." << std::endl;
+        return 1;
+    }
+    catch (const TraceError &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
 
-        // Reset the file stream to the beginning of the file again
-        inputFile.clear();
-        inputFile.seekg(0, std::ios::beg);
+    Report report;
+    try
+    {
+        // Initialize the cache with the desired parameters
+        int cache_size = std::stoi(positional[1]);
+        int associativity = std::stoi(positional[2]);
+        int block_size = std::stoi(positional[3]);
 
-        // Second run through the patterns
-        while (inputFile >> std::hex >> address && address <= upperBound) // Check against the updated upper bound
+        if (!options.upper_levels.empty())
+        {
+            if (options.threads > 1)
+                std::cerr << "Note: a cache hierarchy is simulated on one thread" << std::endl;
+            std::vector<LevelConfig> levels = options.upper_levels;
+            levels.push_back(LevelConfig{cache_size, associativity});
+            withPolicy(options.policy, [&](auto tag)
+                       { simulateHierarchy<typename decltype(tag)::type>(report, *source, levels, block_size, options.inclusion, options.seed, options.passes); });
+        }
+        else
         {
-            // check for hit on read or write
-            if (cache.access(address))
-                hits2++;
-            accesses2++;
+            withPolicy(options.policy, [&](auto tag) {
+                simulate<typename decltype(tag)::type>(report, *source, cache_size, associativity, block_size, options.seed, options.threads, options.passes);
+            });
+        }
+    }
+    catch (const std::logic_error &e)
+    {
+        // Bad cache parameters or a policy that cannot model this geometry
+        std::cerr << "Error: " << e.what() << "." << std::endl;
+        return 1;
+    }
+    catch (const TraceError &e)
+    {
+        // Packed traces are decoded while they are replayed
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
 
-    // Output hit rate for the second run
-    double hitRate2 = (accesses2 > 0) ? static_cast<double>(hits2) / accesses2 : 0.0;
-    std::cout << "Second Run - Hits: " << hits2 << ", Accesses: " << accesses2 << std::endl;
-    std::cout << "Second Run - Hit Rate: " << hitRate2 << std::endl;
-
+    report.write(std::cout, options.format);
     return 0;
 }
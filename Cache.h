@@ -0,0 +1,268 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "AlignedArray.h"
+#include "ReplacementPolicy.h"
+#include "TagMatch.h"
+
+template <typename Policy, int Ways, int BlockShift>
+class CacheKernel;
+
+// Set-associative cache with the replacement policy fixed at compile time
+template <typename Policy>
+class Cache
+{
+private:
+    // Specialized access kernels work on the tag store directly
+    template <typename P, int Ways, int BlockShift>
+    friend class CacheKernel;
+
+    // Tag value marking an invalid way
+    static constexpr Tag kInvalidTag = ~static_cast<Tag>(0);
+
+    // Define cache parameters
+    int size; // in bytes
+    int associativity;
+    int block_size;
+    int sets;
+
+    // Tag store: one contiguous, cache-line aligned allocation holding the
+    // tags of every way, set-major, each set as its low then its high tag
+    // halves. A way is valid when its tag is not kInvalidTag.
+    AlignedArray<std::uint32_t> tags;
+    Policy policy;
+
+    // Reset generation. A set whose epoch is behind the cache's still holds
+    // the contents of an earlier run and is cleared when it is next touched.
+    std::uint32_t epoch = 0;
+    AlignedArray<std::uint32_t> set_epochs;
+
+public:
+    Cache(int size, int associativity, int block_size, std::uint64_t seed = 1) : size(size), associativity(associativity), block_size(block_size)
+    {
+        if (associativity <= 0 || block_size <= 0)
+            throw std::invalid_argument("associativity and block size must be positive");
+
+        // Calculate the number of sets
+        sets = size / (associativity * block_size);
+        if (sets <= 0)
+            throw std::invalid_argument("cache must hold at least one set");
+
+        // Initialize cache state
+        tags = AlignedArray<std::uint32_t>(static_cast<std::size_t>(sets) * associativity * 2);
+        policy = Policy(sets, associativity, seed);
+        set_epochs = AlignedArray<std::uint32_t>(sets);
+        clearAll();
+    }
+
+    bool access(std::uint64_t address)
+    {
+        // Simulate cache behavior for the given address
+        int set_index;
+        int way;
+        return place(address / static_cast<std::uint64_t>(block_size), set_index, way);
+    }
+
+    // Like access, for an address already divided by the block size
+    bool accessBlock(std::uint64_t block)
+    {
+        int set_index;
+        int way;
+        return place(block, set_index, way);
+    }
+
+    // Simulates `count` back-to-back accesses to block number `block` and
+    // returns the hits: all of them but maybe the first, which alone needs
+    // a tag lookup
+    std::uint64_t accessRun(std::uint64_t block, std::uint32_t count)
+    {
+        int set_index;
+        int way;
+        bool hit = place(block, set_index, way);
+        repeatHits(set_index, way, count - 1, hit);
+        return static_cast<std::uint64_t>(hit) + (count - 1);
+    }
+
+    // Looks a block number up without filling it on a miss; a hit counts
+    // for the policy as it does in accessBlock
+    bool probeBlock(std::uint64_t block)
+    {
+        int set_index = static_cast<int>(block % static_cast<std::uint64_t>(sets));
+        WayMatch match = lookup(block, set_index);
+        if (match.hit < 0)
+            return false;
+        policy.onHit(set_index, match.hit);
+        return true;
+    }
+
+    // Puts a block number into the cache and says whether a valid block
+    // was evicted for it, which is left in `evicted`. A block already held
+    // is only referenced.
+    bool fillBlock(std::uint64_t block, std::uint64_t &evicted)
+    {
+        int set_index = static_cast<int>(block % static_cast<std::uint64_t>(sets));
+        WayMatch match = lookup(block, set_index);
+        if (match.hit >= 0)
+        {
+            policy.onHit(set_index, match.hit);
+            return false;
+        }
+
+        std::uint32_t *set_tags = tagsOf(set_index);
+        bool was_valid = match.invalid < 0;
+        int way = was_valid ? policy.victim(set_index) : match.invalid;
+        if (was_valid)
+            evicted = loadTag(set_tags, associativity, way) * static_cast<std::uint64_t>(sets) + static_cast<std::uint64_t>(set_index);
+        storeTag(set_tags, associativity, way, block / static_cast<std::uint64_t>(sets));
+        policy.onFill(set_index, way, was_valid);
+        return was_valid;
+    }
+
+    // Removes a block number from the cache and says whether it was held
+    bool invalidateBlock(std::uint64_t block)
+    {
+        int set_index = static_cast<int>(block % static_cast<std::uint64_t>(sets));
+        WayMatch match = lookup(block, set_index);
+        if (match.hit < 0)
+            return false;
+        storeTag(tagsOf(set_index), associativity, match.hit, kInvalidTag);
+        policy.onInvalidate(set_index, match.hit);
+        return true;
+    }
+
+    // Starts loading the metadata of the set the address maps to, ahead
+    // of an access to it
+    void prefetch(std::uint64_t address) const
+    {
+        prefetchBlock(address / static_cast<std::uint64_t>(block_size));
+    }
+
+    void prefetchBlock(std::uint64_t block) const
+    {
+        int set_index = static_cast<int>(block % static_cast<std::uint64_t>(sets));
+        prefetchLine(tags.get() + static_cast<std::size_t>(set_index) * associativity * 2);
+        prefetchLine(set_epochs.get() + set_index);
+        policy.prefetch(set_index);
+    }
+
+    void resetCacheState()
+    {
+        // Reset the cache state for the next run in constant time: every
+        // set goes stale at once. Clear everything only when the epoch
+        // counter wraps and old epochs could look current again.
+        if (++epoch == 0)
+            clearAll();
+        policy.resetShared();
+    }
+
+    // Whether the other cache, of the same geometry, would give the same
+    // hits as this one from here on, for any accesses: every set holds the
+    // same blocks under the same policy state, in the same ways where the
+    // policy's choices depend on them
+    bool sameState(const Cache &other) const
+    {
+        if (sets != other.sets || associativity != other.associativity || block_size != other.block_size || epoch != other.epoch)
+            return false;
+        if (!policy.sameShared(other.policy))
+            return false;
+
+        const std::size_t setWords = static_cast<std::size_t>(associativity) * 2;
+        for (int set_index = 0; set_index < sets; ++set_index)
+        {
+            // A stale set is empty; one that is stale on one side only is
+            // counted as different, which is safe
+            bool stale = set_epochs[set_index] != epoch;
+            if (stale != (other.set_epochs[set_index] != epoch))
+                return false;
+            if (stale)
+                continue;
+
+            const std::uint32_t *mine = tags.get() + set_index * setWords;
+            const std::uint32_t *theirs = other.tags.get() + set_index * setWords;
+            auto sameWay = [&](int way, int other_way)
+            { return loadTag(mine, associativity, way) == loadTag(theirs, associativity, other_way); };
+            if (!policy.sameSet(other.policy, set_index, sameWay))
+                return false;
+        }
+        return true;
+    }
+
+    int getSets() const { return sets; }
+    int getAssociativity() const { return associativity; }
+    int getBlockSize() const { return block_size; }
+
+private:
+    // Simulates an access to a block and says whether it hit; the block
+    // ends up in way `way` of set `set_index`
+    FORCE_INLINE bool place(std::uint64_t block, int &set_index, int &way)
+    {
+        set_index = static_cast<int>(block % static_cast<std::uint64_t>(sets));
+        Tag tag = block / static_cast<std::uint64_t>(sets);
+
+        if (set_epochs[set_index] != epoch)
+            clearSet(set_index);
+
+        std::uint32_t *set_tags = tagsOf(set_index);
+
+        // Check if the block is in the cache
+        WayMatch match = matchWays(set_tags, associativity, tag, kInvalidTag);
+        if (match.hit >= 0)
+        {
+            // Cache hit
+            way = match.hit;
+            policy.onHit(set_index, way);
+            return true;
+        }
+
+        // Cache miss: fill the first invalid way, else ask the policy
+        bool was_valid = match.invalid < 0;
+        way = was_valid ? policy.victim(set_index) : match.invalid;
+        storeTag(set_tags, associativity, way, tag);
+        policy.onFill(set_index, way, was_valid);
+        return false;
+    }
+
+    // Finds a block number in its set, which is cleared first if stale
+    WayMatch lookup(std::uint64_t block, int set_index)
+    {
+        if (set_epochs[set_index] != epoch)
+            clearSet(set_index);
+        return matchWays(tagsOf(set_index), associativity, block / static_cast<std::uint64_t>(sets), kInvalidTag);
+    }
+
+    // The policy's part of `count` more hits on the way an access just
+    // left its block in. Under idempotent hits only a hit right after a
+    // fill can change anything.
+    void repeatHits(int set_index, int way, std::uint32_t count, bool after_hit)
+    {
+        if constexpr (Policy::kIdempotentHits)
+            count = after_hit ? 0 : std::min<std::uint32_t>(count, 1);
+        for (std::uint32_t i = 0; i < count; ++i)
+            policy.onHit(set_index, way);
+    }
+
+    void clearSet(int set_index)
+    {
+        // Both halves of kInvalidTag are all ones
+        std::uint32_t *set_tags = tagsOf(set_index);
+        std::fill(set_tags, set_tags + associativity * 2, lowHalf(kInvalidTag));
+        policy.resetSet(set_index);
+        set_epochs[set_index] = epoch;
+    }
+
+    void clearAll()
+    {
+        tags.fill(lowHalf(kInvalidTag));
+        policy.reset();
+        set_epochs.fill(epoch);
+    }
+
+    std::uint32_t *tagsOf(int set_index) { return tags.get() + static_cast<std::size_t>(set_index) * associativity * 2; }
+};
+
+#endif
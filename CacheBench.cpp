@@ -0,0 +1,431 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Cache.h"
+#include "CacheKernel.h"
+#include "Trace.h"
+
+// cache-bench: measures the throughput of Cache::access, in accesses per
+// second, for every combination of policy, associativity, block size and
+// trace shape, repeated to give percentiles
+
+// Synthetic address patterns
+struct TraceShape
+{
+    std::string name;
+    std::vector<Address> addresses;
+};
+
+// Uniform random addresses over a footprint of `span` bytes
+std::vector<Address> randomShape(std::size_t count, Address span, std::uint64_t seed)
+{
+    SplitMix64 rng(seed);
+    std::vector<Address> addresses(count);
+    for (Address &a : addresses)
+        a = static_cast<Address>(rng.next() % span);
+    return addresses;
+}
+
+// Sequential addresses `stride` bytes apart, wrapping at `span` bytes
+std::vector<Address> strideShape(std::size_t count, Address stride, Address span)
+{
+    std::vector<Address> addresses(count);
+    for (std::size_t i = 0; i < count; ++i)
+        addresses[i] = static_cast<Address>((i * stride) % span);
+    return addresses;
+}
+
+// Follows a random cyclic permutation of 64-byte lines, like a linked
+// list walk whose nodes are scattered over `span` bytes
+std::vector<Address> pointerChaseShape(std::size_t count, Address span, std::uint64_t seed)
+{
+    std::size_t lines = std::max<std::size_t>(span / 64, 2);
+    std::vector<std::size_t> order(lines);
+    std::iota(order.begin(), order.end(), 0);
+    SplitMix64 rng(seed);
+    for (std::size_t i = lines - 1; i > 0; --i)
+        std::swap(order[i], order[rng.next() % (i + 1)]);
+
+    std::vector<std::size_t> next(lines);
+    for (std::size_t i = 0; i < lines; ++i)
+        next[order[i]] = order[(i + 1) % lines];
+
+    std::vector<Address> addresses(count);
+    std::size_t node = order[0];
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        addresses[i] = static_cast<Address>(node * 64);
+        node = next[node];
+    }
+    return addresses;
+}
+
+// The sieve of Eratosthenes access pattern of the old simulateCache
+// driver: a read of isComposite[m] for every m, then a read and a write of
+// isComposite[k] for each multiple k of every prime m. Repeated sieves
+// over `span` bytes fill `count` accesses.
+std::vector<Address> sieveShape(std::size_t count, Address span)
+{
+    std::vector<Address> addresses;
+    addresses.reserve(count);
+    std::vector<bool> isComposite(span + 1);
+    while (addresses.size() < count)
+    {
+        std::fill(isComposite.begin(), isComposite.end(), false);
+        for (Address m = 2; m <= span && addresses.size() < count; m++)
+        {
+            addresses.push_back(m);
+            if (isComposite[m])
+                continue;
+            for (Address k = m * m; k <= span && addresses.size() < count; k += m)
+            {
+                isComposite[k] = true;
+                addresses.push_back(k);
+                addresses.push_back(k);
+            }
+        }
+    }
+    addresses.resize(count);
+    return addresses;
+}
+
+// One benchmark cell and its throughput samples
+struct BenchResult
+{
+    std::string policy;
+    std::string shape;
+    int size;
+    int associativity;
+    int block_size;
+    double hit_rate;
+    std::vector<double> rates; // accesses per second, one per repetition
+};
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double> &sorted, double p)
+{
+    std::size_t rank = static_cast<std::size_t>(p / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max<std::size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1];
+}
+
+// How a benchmark cell drives the cache
+enum class BenchKernel
+{
+    Specialized, // accessAll: the geometry kernel where one exists
+    Generic,     // Cache::access for every access
+    Batch        // accessBatch: the geometry kernel, recording a hit bitmap
+};
+
+template <typename Policy>
+BenchResult benchmark(const std::string &policy, const TraceShape &shape, int size, int associativity, int block_size, std::size_t repetitions, BenchKernel kernel)
+{
+    BenchResult result{policy, shape.name, size, associativity, block_size, 0.0, {}};
+    const Address *addresses = shape.addresses.data();
+    const std::size_t count = shape.addresses.size();
+
+    for (std::size_t rep = 0; rep < repetitions; ++rep)
+    {
+        Cache<Policy> cache(size, associativity, block_size);
+        HitBitmap bitmap;
+        std::uint64_t hits = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        if (kernel == BenchKernel::Generic)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                hits += cache.access(addresses[i]);
+        }
+        else if (kernel == BenchKernel::Batch)
+        {
+            hits = accessBatch(cache, addresses, count, bitmap);
+        }
+        else
+        {
+            hits = accessAll(cache, addresses, count);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result.rates.push_back(count / std::max(seconds, 1e-9));
+        result.hit_rate = static_cast<double>(hits) / count;
+    }
+
+    std::sort(result.rates.begin(), result.rates.end());
+    return result;
+}
+
+// Checks that the hit bitmaps of the specialized kernel (through
+// accessBatch) and of the generic one both hold, bit for bit, what
+// Cache::accessBlock says about each access. Returns a description of the
+// first difference, or an empty string.
+template <typename Policy>
+std::string checkBatch(const TraceShape &shape, int size, int associativity, int block_size)
+{
+    const Address *addresses = shape.addresses.data();
+    const std::size_t count = shape.addresses.size();
+
+    Cache<Policy> reference(size, associativity, block_size);
+    std::vector<bool> expected(count);
+    for (std::size_t i = 0; i < count; ++i)
+        expected[i] = reference.accessBlock(addresses[i] / static_cast<Address>(block_size));
+
+    for (BenchKernel kernel : {BenchKernel::Batch, BenchKernel::Generic})
+    {
+        Cache<Policy> cache(size, associativity, block_size);
+        HitBitmap bitmap;
+        std::uint64_t hits;
+        if (kernel == BenchKernel::Batch)
+        {
+            hits = accessBatch(cache, addresses, count, bitmap);
+        }
+        else
+        {
+            bitmap.reset(count);
+            hits = runGeneric<Policy, Address>(cache, addresses, count, &bitmap);
+        }
+
+        const char *name = kernel == BenchKernel::Batch ? "specialized" : "generic";
+        if (bitmap.size() != count)
+            return std::string(name) + " bitmap holds " + std::to_string(bitmap.size()) + " bits";
+        std::uint64_t counted = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (bitmap.test(i) != expected[i])
+                return std::string(name) + " bitmap differs from accessBlock at access " + std::to_string(i);
+            counted += expected[i];
+        }
+        if (hits != counted)
+            return std::string(name) + " kernel counts " + std::to_string(hits) + " hits, accessBlock " + std::to_string(counted);
+    }
+    return "";
+}
+
+// Parses a comma-separated list of positive integers
+std::vector<int> parseIntList(const std::string &text)
+{
+    std::vector<int> values;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        int value = std::stoi(item);
+        if (value <= 0)
+            throw std::invalid_argument("values must be positive");
+        values.push_back(value);
+    }
+    if (values.empty())
+        throw std::invalid_argument("empty list");
+    return values;
+}
+
+// Parses a positive count; stoul would wrap a negative one around
+std::size_t parseCount(const std::string &text)
+{
+    long long value = std::stoll(text);
+    if (value <= 0)
+        throw std::invalid_argument("value must be positive");
+    return static_cast<std::size_t>(value);
+}
+
+std::vector<std::string> parseNameList(const std::string &text)
+{
+    std::vector<std::string> names;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ','))
+        names.push_back(item);
+    return names;
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --size <n>          cache size in bytes (default 32768)" << std::endl;
+    std::cerr << "  --ways <list>       associativities (default 1,2,4,8,16)" << std::endl;
+    std::cerr << "  --blocks <list>     block sizes (default 4,16,64)" << std::endl;
+    std::cerr << "  --policies <list>   policies (default: all)" << std::endl;
+    std::cerr << "  --shapes <list>     random, stride8, stride64, chase, sieve (default: all)" << std::endl;
+    std::cerr << "  --accesses <n>      accesses per trace (default 2000000)" << std::endl;
+    std::cerr << "  --reps <n>          repetitions per cell (default 5)" << std::endl;
+    std::cerr << "  --kernel <name>     specialized (geometry kernels where they exist, default)," << std::endl;
+    std::cerr << "                      generic (Cache::access for every access) or batch" << std::endl;
+    std::cerr << "                      (accessBatch, which also records a hit bitmap)" << std::endl;
+    std::cerr << "  --check             before timing a cell, check that the specialized and" << std::endl;
+    std::cerr << "                      generic kernels' hit bitmaps match Cache::accessBlock" << std::endl;
+    std::cerr << "  --out <file>        results file, JSON if it ends in .json, else CSV" << std::endl;
+    std::cerr << "                      (default cache_bench.csv)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 32768;
+    std::vector<int> ways = {1, 2, 4, 8, 16};
+    std::vector<int> blocks = {4, 16, 64};
+    std::vector<std::string> policies;
+    for (const char *const *name = policyNames(); *name != nullptr; ++name)
+        policies.push_back(*name);
+    std::vector<std::string> shapeNames = {"random", "stride8", "stride64", "chase", "sieve"};
+    std::size_t accesses = 2000000;
+    std::size_t repetitions = 5;
+    BenchKernel kernel = BenchKernel::Specialized;
+    bool check = false;
+    std::string out = "cache_bench.csv";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--check")
+        {
+            check = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        try
+        {
+            if (arg == "--size")
+            {
+                size = std::stoi(value);
+                if (size <= 0)
+                    throw std::invalid_argument("value must be positive");
+            }
+            else if (arg == "--ways")
+                ways = parseIntList(value);
+            else if (arg == "--blocks")
+                blocks = parseIntList(value);
+            else if (arg == "--policies")
+                policies = parseNameList(value);
+            else if (arg == "--shapes")
+                shapeNames = parseNameList(value);
+            else if (arg == "--accesses")
+                accesses = parseCount(value);
+            else if (arg == "--reps")
+                repetitions = parseCount(value);
+            else if (arg == "--kernel" && (value == "generic" || value == "specialized" || value == "batch"))
+                kernel = value == "generic" ? BenchKernel::Generic : value == "batch" ? BenchKernel::Batch : BenchKernel::Specialized;
+            else if (arg == "--out")
+                out = value;
+            else
+            {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: Invalid value for " << arg << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Footprint of four cache sizes keeps every shape missing now and then
+    const Address span = static_cast<Address>(size) * 4;
+    std::vector<TraceShape> shapes;
+    for (const std::string &name : shapeNames)
+    {
+        if (name == "random")
+            shapes.push_back({name, randomShape(accesses, span, 1)});
+        else if (name == "stride8")
+            shapes.push_back({name, strideShape(accesses, 8, span)});
+        else if (name == "stride64")
+            shapes.push_back({name, strideShape(accesses, 64, span)});
+        else if (name == "chase")
+            shapes.push_back({name, pointerChaseShape(accesses, span, 1)});
+        else if (name == "sieve")
+            shapes.push_back({name, sieveShape(accesses, span)});
+        else
+        {
+            std::cerr << "Error: Unknown trace shape " << name << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    try
+    {
+        for (const std::string &policy : policies)
+        {
+            PolicyKind kind = parsePolicyKind(policy);
+            for (const TraceShape &shape : shapes)
+                for (int associativity : ways)
+                    for (int block_size : blocks)
+                    {
+                        if (size / (associativity * block_size) <= 0)
+                            continue;
+                        if (check)
+                        {
+                            std::string problem = withPolicy(kind, [&](auto tag)
+                                                             { return checkBatch<typename decltype(tag)::type>(shape, size, associativity, block_size); });
+                            if (!problem.empty())
+                            {
+                                std::cerr << "Error: " << policy << " " << shape.name << " " << associativity << "-way " << block_size << "B: " << problem << std::endl;
+                                return 1;
+                            }
+                        }
+                        BenchResult result = withPolicy(kind, [&](auto tag)
+                                                        { return benchmark<typename decltype(tag)::type>(policy, shape, size, associativity, block_size, repetitions, kernel); });
+                        std::cout << policy << " " << shape.name << " " << associativity << "-way " << block_size << "B: "
+                                  << percentile(result.rates, 50) / 1e6 << " M accesses/s\n";
+                        results.push_back(result);
+                    }
+        }
+    }
+    catch (const std::logic_error &e)
+    {
+        std::cerr << "Error: " << e.what() << "." << std::endl;
+        return 1;
+    }
+
+    std::ostringstream text;
+    bool json = out.size() >= 5 && out.compare(out.size() - 5, 5, ".json") == 0;
+    if (json)
+        text << "[\n";
+    else
+        text << "policy,shape,size,associativity,block_size,hit_rate,accesses,repetitions,min,p50,p90,p99,max\n";
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult &r = results[i];
+        if (json)
+        {
+            text << "  {\"policy\": \"" << r.policy << "\", \"shape\": \"" << r.shape << "\", \"size\": " << r.size
+                 << ", \"associativity\": " << r.associativity << ", \"block_size\": " << r.block_size
+                 << ", \"hit_rate\": " << r.hit_rate << ", \"accesses\": " << accesses << ", \"repetitions\": " << repetitions
+                 << ", \"min\": " << r.rates.front() << ", \"p50\": " << percentile(r.rates, 50)
+                 << ", \"p90\": " << percentile(r.rates, 90) << ", \"p99\": " << percentile(r.rates, 99)
+                 << ", \"max\": " << r.rates.back() << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        else
+        {
+            text << r.policy << "," << r.shape << "," << r.size << "," << r.associativity << "," << r.block_size << ","
+                 << r.hit_rate << "," << accesses << "," << repetitions << "," << r.rates.front() << ","
+                 << percentile(r.rates, 50) << "," << percentile(r.rates, 90) << "," << percentile(r.rates, 99) << ","
+                 << r.rates.back() << "\n";
+        }
+    }
+    if (json)
+        text << "]\n";
+
+    std::ofstream file(out);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Unable to create file " << out << std::endl;
+        return 1;
+    }
+    file << text.str();
+    std::cout << "Wrote " << results.size() << " results to " << out << std::endl;
+    return 0;
+}
@@ -0,0 +1,208 @@
+#ifndef CACHE_HIERARCHY_H
+#define CACHE_HIERARCHY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Cache.h"
+#include "CacheKernel.h"
+#include "Trace.h"
+#include "TraceSource.h"
+
+// Multi-level cache hierarchy: levels of Cache<Policy> sharing one block
+// size, nearest the core first. Each access probes the levels in order
+// until one holds the block; every level that missed is then filled,
+// lowest first, so the whole hierarchy is simulated in one pass over the
+// trace.
+//
+// The levels above the last are non-inclusive non-exclusive (NINE): their
+// victims are dropped. The last level relates to them as chosen:
+//
+//   nine       fills on every miss and evicts independently
+//   inclusive  fills on every miss; its victims are back-invalidated in
+//              every level above
+//   exclusive  holds only blocks evicted from the level above it (victim
+//              fills); a hit moves the block up and out of it
+
+enum class Inclusion
+{
+    Nine,
+    Inclusive,
+    Exclusive
+};
+
+inline Inclusion parseInclusion(const std::string &name)
+{
+    if (name == "nine")
+        return Inclusion::Nine;
+    if (name == "inclusive")
+        return Inclusion::Inclusive;
+    if (name == "exclusive")
+        return Inclusion::Exclusive;
+    throw std::invalid_argument("unknown inclusion policy " + name);
+}
+
+inline const char *inclusionName(Inclusion inclusion)
+{
+    static const char *const names[] = {"nine", "inclusive", "exclusive"};
+    return names[static_cast<int>(inclusion)];
+}
+
+// Size and associativity of one level; the block size is the hierarchy's
+struct LevelConfig
+{
+    int size;
+    int associativity;
+};
+
+// Counters of one level. Misses of a level are its requests to the next
+// one, or to memory for the last.
+struct LevelStats
+{
+    std::uint64_t accesses = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t fills = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t back_invalidations = 0; // blocks taken away by an inclusive last level
+    std::uint64_t victims = 0;            // evicted blocks written into the next level
+
+    std::uint64_t misses() const { return accesses - hits; }
+    double hitRate() const { return accesses > 0 ? static_cast<double>(hits) / accesses : 0.0; }
+
+    LevelStats &operator+=(const LevelStats &other)
+    {
+        accesses += other.accesses;
+        hits += other.hits;
+        fills += other.fills;
+        evictions += other.evictions;
+        back_invalidations += other.back_invalidations;
+        victims += other.victims;
+        return *this;
+    }
+};
+
+template <typename Policy>
+class CacheHierarchy
+{
+private:
+    std::vector<Cache<Policy>> levels;
+    std::vector<LevelStats> stats;
+    Inclusion inclusion;
+    int block_size;
+
+public:
+    CacheHierarchy(const std::vector<LevelConfig> &configs, int block_size, Inclusion inclusion, std::uint64_t seed = 1)
+        : stats(configs.size()), inclusion(configs.size() > 1 ? inclusion : Inclusion::Nine), block_size(block_size)
+    {
+        if (configs.empty())
+            throw std::invalid_argument("a cache hierarchy needs at least one level");
+        levels.reserve(configs.size());
+        for (const LevelConfig &config : configs)
+            levels.emplace_back(config.size, config.associativity, block_size, seed);
+    }
+
+    // Simulates an access to a block number and says whether any level
+    // held it
+    bool accessBlock(std::uint64_t block)
+    {
+        const std::size_t last = levels.size() - 1;
+        std::size_t level = 0;
+        while (level <= last)
+        {
+            ++stats[level].accesses;
+            if (levels[level].probeBlock(block))
+            {
+                ++stats[level].hits;
+                break;
+            }
+            ++level;
+        }
+
+        // An exclusive last level gives the block up to the level above
+        if (level == last && inclusion == Inclusion::Exclusive)
+            levels[last].invalidateBlock(block);
+
+        // Lowest level first, so an inclusive last level evicts before the
+        // levels above take the block, never after
+        for (std::size_t i = std::min(level, levels.size()); i-- > 0;)
+        {
+            if (i == last && inclusion == Inclusion::Exclusive)
+                continue;
+            fill(i, block);
+        }
+        return level <= last;
+    }
+
+    // Replays the filtered trace once through every level and adds up the
+    // accesses and the hits in any level
+    void runPass(const TraceSource &source, std::uint64_t &hits, std::uint64_t &accesses)
+    {
+        Cache<Policy> &first = levels.front();
+        const bool prefetching = shouldPrefetch(first);
+        const std::uint64_t divisor = static_cast<std::uint64_t>(block_size);
+        source.replay([&](const Address *addresses, std::size_t count)
+                      {
+            const std::size_t prefetchEnd = prefetching && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (i < prefetchEnd)
+                    first.prefetch(addresses[i + kPrefetchDistance]);
+                hits += accessBlock(addresses[i] / divisor);
+            }
+            accesses += count;
+            return true; });
+    }
+
+    // Whether every level is in the same state as in the other hierarchy
+    bool sameState(const CacheHierarchy &other) const
+    {
+        if (levels.size() != other.levels.size() || inclusion != other.inclusion)
+            return false;
+        for (std::size_t i = 0; i < levels.size(); ++i)
+        {
+            if (!levels[i].sameState(other.levels[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // Counters since construction or the last takeStats, which clears them
+    std::vector<LevelStats> takeStats()
+    {
+        std::vector<LevelStats> taken(levels.size());
+        taken.swap(stats);
+        return taken;
+    }
+
+    std::size_t depth() const { return levels.size(); }
+    Inclusion getInclusion() const { return inclusion; }
+
+private:
+    // Puts the block into one level and passes on what it evicts
+    void fill(std::size_t i, std::uint64_t block)
+    {
+        const std::size_t last = levels.size() - 1;
+        std::uint64_t victim;
+        ++stats[i].fills;
+        if (!levels[i].fillBlock(block, victim))
+            return;
+        ++stats[i].evictions;
+
+        if (i == last && inclusion == Inclusion::Inclusive)
+        {
+            for (std::size_t j = 0; j < last; ++j)
+                stats[j].back_invalidations += levels[j].invalidateBlock(victim);
+        }
+        else if (i + 1 == last && inclusion == Inclusion::Exclusive)
+        {
+            ++stats[i].victims;
+            fill(last, victim);
+        }
+    }
+};
+
+#endif
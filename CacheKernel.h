@@ -0,0 +1,462 @@
+#ifndef CACHE_KERNEL_H
+#define CACHE_KERNEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BlockRuns.h"
+#include "BlockStream.h"
+#include "Cache.h"
+#include "TagMatch.h"
+
+// Access kernels specialized at compile time for the power-of-two
+// geometries of the usual sweeps. With the associativity and block size
+// known, the way loop unrolls completely and the block and set index come
+// from shifts and masks instead of divisions. Everything else goes through
+// Cache::access, and both give the same hits and the same cache state.
+// Sets of eight or sixteen ways are searched with AVX2 when the CPU has
+// it, using a copy of the kernel loop compiled for AVX2. Same-block runs
+// and precomputed block streams go through the kernels with a block shift
+// of zero, as they hold block numbers rather than addresses.
+//
+// When the tag store is too big for the host's L2, every loop prefetches
+// the set metadata of the access kPrefetchDistance ahead, so the host's
+// miss on it overlaps with the accesses in between instead of stalling
+// each one in turn.
+
+// Accesses between a prefetch and the access it is for
+constexpr std::size_t kPrefetchDistance = 16;
+
+// Smallest tag store worth prefetching for; smaller ones stay cached
+constexpr std::size_t kPrefetchMinBytes = std::size_t(1) << 20;
+
+template <typename Policy>
+bool shouldPrefetch(const Cache<Policy> &cache)
+{
+    return static_cast<std::size_t>(cache.getSets()) * cache.getAssociativity() * sizeof(Tag) >= kPrefetchMinBytes;
+}
+
+// One bit per access of a batch, set where the access hit
+class HitBitmap
+{
+private:
+    std::vector<std::uint64_t> words;
+    std::size_t bits = 0;
+
+public:
+    // Clears the bitmap to `count` misses
+    void reset(std::size_t count)
+    {
+        bits = count;
+        words.assign((count + 63) / 64, 0);
+    }
+
+    bool test(std::size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+    std::size_t size() const { return bits; }
+    std::uint64_t *data() { return words.data(); }
+};
+
+template <typename Policy, int Ways, int BlockShift>
+class CacheKernel
+{
+private:
+    Cache<Policy> &cache;
+    std::uint64_t set_mask;
+    int set_shift;
+
+public:
+    // The set count must be a power of two
+    explicit CacheKernel(Cache<Policy> &cache) : cache(cache), set_mask(static_cast<std::uint64_t>(cache.sets) - 1), set_shift(0)
+    {
+        while ((1 << set_shift) < cache.sets)
+            ++set_shift;
+    }
+
+    FORCE_INLINE void prefetch(std::uint64_t address) const
+    {
+        std::uint64_t block = address >> BlockShift;
+        std::size_t set_index = static_cast<std::size_t>(block & set_mask);
+        prefetchLine(cache.tags.get() + set_index * Ways * 2);
+        prefetchLine(cache.set_epochs.get() + set_index);
+        cache.policy.prefetch(static_cast<int>(set_index));
+    }
+
+    FORCE_INLINE bool access(std::uint64_t address)
+    {
+        Slot slot = locate(address);
+        WayMatch match = lookup(slot);
+        resolve(slot, match);
+        return match.hit >= 0;
+    }
+
+    // Like Cache::accessRun, for an address whose block is the run's block
+    FORCE_INLINE std::uint64_t accessRun(std::uint64_t address, std::uint32_t count)
+    {
+        Slot slot = locate(address);
+        WayMatch match = lookup(slot);
+        cache.repeatHits(slot.set_index, resolve(slot, match), count - 1, match.hit >= 0);
+        return static_cast<std::uint64_t>(match.hit >= 0) + (count - 1);
+    }
+
+#ifdef TAG_MATCH_AVX2
+    // Built for AVX2 so the vector lookup inlines; ways must be a multiple
+    // of eight and the CPU must have AVX2
+    __attribute__((target("avx2"))) FORCE_INLINE bool accessAvx2(std::uint64_t address)
+    {
+        Slot slot = locate(address);
+        WayMatch match = matchWaysAvx2(slot.set_tags, Ways, slot.tag, Cache<Policy>::kInvalidTag);
+        resolve(slot, match);
+        return match.hit >= 0;
+    }
+
+    __attribute__((target("avx2"))) FORCE_INLINE std::uint64_t accessRunAvx2(std::uint64_t address, std::uint32_t count)
+    {
+        Slot slot = locate(address);
+        WayMatch match = matchWaysAvx2(slot.set_tags, Ways, slot.tag, Cache<Policy>::kInvalidTag);
+        cache.repeatHits(slot.set_index, resolve(slot, match), count - 1, match.hit >= 0);
+        return static_cast<std::uint64_t>(match.hit >= 0) + (count - 1);
+    }
+#endif
+
+private:
+    // Where an address lives: its set, that set's tags and its tag
+    struct Slot
+    {
+        int set_index;
+        std::uint32_t *set_tags;
+        Tag tag;
+    };
+
+    FORCE_INLINE Slot locate(std::uint64_t address)
+    {
+        std::uint64_t block = address >> BlockShift;
+        int set_index = static_cast<int>(block & set_mask);
+
+        if (cache.set_epochs[set_index] != cache.epoch)
+            cache.clearSet(set_index);
+
+        return Slot{set_index, cache.tags.get() + static_cast<std::size_t>(set_index) * Ways * 2, block >> set_shift};
+    }
+
+    // Baseline lookup: SSE2 for whole groups of four ways, else scalar
+    FORCE_INLINE WayMatch lookup(const Slot &slot) const
+    {
+#ifdef TAG_MATCH_SSE2
+        if constexpr (Ways % 4 == 0)
+            return matchWaysSse2(slot.set_tags, Ways, slot.tag, Cache<Policy>::kInvalidTag);
+#endif
+        // Constant trip count: unrolled by the compiler
+        return matchWaysScalar(slot.set_tags, Ways, slot.tag, Cache<Policy>::kInvalidTag);
+    }
+
+    // Updates the set after a lookup and returns the way now holding the
+    // block
+    FORCE_INLINE int resolve(const Slot &slot, WayMatch match)
+    {
+        if (match.hit >= 0)
+        {
+            cache.policy.onHit(slot.set_index, match.hit);
+            return match.hit;
+        }
+
+        bool was_valid = match.invalid < 0;
+        int victim_index = was_valid ? cache.policy.victim(slot.set_index) : match.invalid;
+        storeTag(slot.set_tags, Ways, victim_index, slot.tag);
+        cache.policy.onFill(slot.set_index, victim_index, was_valid);
+        return victim_index;
+    }
+};
+
+// Adds up hits and, when there is a bitmap, stores them a word at a time
+class HitRecorder
+{
+private:
+    std::uint64_t *words;
+    std::uint64_t word = 0;
+    std::uint64_t hits = 0;
+
+public:
+    explicit HitRecorder(HitBitmap *bitmap) : words(bitmap != nullptr ? bitmap->data() : nullptr) {}
+
+    // Inlined into every kernel loop; the bitmap store is kept out of it
+    FORCE_INLINE void record(std::size_t i, bool hit)
+    {
+        hits += hit;
+        if (words != nullptr)
+            store(i, hit);
+    }
+
+    std::uint64_t finish(std::size_t count)
+    {
+        if (words != nullptr && count % 64 != 0)
+            flush(count - 1);
+        return hits;
+    }
+
+private:
+    void store(std::size_t i, bool hit)
+    {
+        word |= static_cast<std::uint64_t>(hit) << (i % 64);
+        if (i % 64 == 63)
+            flush(i);
+    }
+
+    void flush(std::size_t i)
+    {
+        words[i / 64] = word;
+        word = 0;
+    }
+};
+
+template <typename Policy, typename T>
+using KernelLoop = std::uint64_t (*)(Cache<Policy> &, const T *, std::size_t, HitBitmap *);
+
+template <typename Policy, typename T, int Ways, int BlockShift>
+std::uint64_t runKernel(Cache<Policy> &cache, const T *addresses, std::size_t count, HitBitmap *bitmap)
+{
+    CacheKernel<Policy, Ways, BlockShift> kernel(cache);
+    HitRecorder recorder(bitmap);
+    const std::size_t prefetchEnd = shouldPrefetch(cache) && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < prefetchEnd)
+            kernel.prefetch(addresses[i + kPrefetchDistance]);
+        recorder.record(i, kernel.access(addresses[i]));
+    }
+    return recorder.finish(count);
+}
+
+#ifdef TAG_MATCH_AVX2
+// The same loop built for AVX2
+template <typename Policy, typename T, int Ways, int BlockShift>
+__attribute__((target("avx2"))) std::uint64_t runKernelAvx2(Cache<Policy> &cache, const T *addresses, std::size_t count, HitBitmap *bitmap)
+{
+    CacheKernel<Policy, Ways, BlockShift> kernel(cache);
+    HitRecorder recorder(bitmap);
+    const std::size_t prefetchEnd = shouldPrefetch(cache) && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < prefetchEnd)
+            kernel.prefetch(addresses[i + kPrefetchDistance]);
+        recorder.record(i, kernel.accessAvx2(addresses[i]));
+    }
+    return recorder.finish(count);
+}
+
+template <typename Policy, typename T, int Ways>
+constexpr std::array<KernelLoop<Policy, T>, 5> avx2KernelRow()
+{
+    return {runKernelAvx2<Policy, T, Ways, 2>, runKernelAvx2<Policy, T, Ways, 3>, runKernelAvx2<Policy, T, Ways, 4>,
+            runKernelAvx2<Policy, T, Ways, 5>, runKernelAvx2<Policy, T, Ways, 6>};
+}
+#endif
+
+// Kernels for 4 to 64 byte blocks at one associativity
+template <typename Policy, typename T, int Ways>
+constexpr std::array<KernelLoop<Policy, T>, 5> kernelRow()
+{
+    return {runKernel<Policy, T, Ways, 2>, runKernel<Policy, T, Ways, 3>, runKernel<Policy, T, Ways, 4>,
+            runKernel<Policy, T, Ways, 5>, runKernel<Policy, T, Ways, 6>};
+}
+
+// Any geometry, one Cache::access per address
+template <typename Policy, typename T>
+std::uint64_t runGeneric(Cache<Policy> &cache, const T *addresses, std::size_t count, HitBitmap *bitmap)
+{
+    HitRecorder recorder(bitmap);
+    const std::size_t prefetchEnd = shouldPrefetch(cache) && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < prefetchEnd)
+            cache.prefetch(addresses[i + kPrefetchDistance]);
+        recorder.record(i, cache.access(addresses[i]));
+    }
+    return recorder.finish(count);
+}
+
+inline int log2IfPowerOfTwo(int value)
+{
+    if (value <= 0 || (value & (value - 1)) != 0)
+        return -1;
+    int shift = 0;
+    while ((1 << shift) < value)
+        ++shift;
+    return shift;
+}
+
+// The loop for this cache's geometry: a specialization for 1 to 16 ways,
+// 4 to 64 byte blocks and a power-of-two set count, otherwise the generic
+// Cache::access. The AVX2 kernels take over for 8 and 16 ways.
+template <typename Policy, typename T>
+KernelLoop<Policy, T> kernelFor(const Cache<Policy> &cache)
+{
+    // Rows by log2 of the associativity, columns by log2 of the block size
+    static constexpr std::array<std::array<KernelLoop<Policy, T>, 5>, 5> kernels = {
+        kernelRow<Policy, T, 1>(), kernelRow<Policy, T, 2>(), kernelRow<Policy, T, 4>(),
+        kernelRow<Policy, T, 8>(), kernelRow<Policy, T, 16>()};
+
+    int waysShift = log2IfPowerOfTwo(cache.getAssociativity());
+    int blockShift = log2IfPowerOfTwo(cache.getBlockSize());
+    if (waysShift < 0 || waysShift >= 5 || blockShift < 2 || blockShift > 6 || log2IfPowerOfTwo(cache.getSets()) < 0)
+        return runGeneric<Policy, T>;
+
+#ifdef TAG_MATCH_AVX2
+    static constexpr std::array<std::array<KernelLoop<Policy, T>, 5>, 2> avx2Kernels = {
+        avx2KernelRow<Policy, T, 8>(), avx2KernelRow<Policy, T, 16>()};
+    if (waysShift >= 3 && hasAvx2())
+        return avx2Kernels[waysShift - 3][blockShift - 2];
+#endif
+    return kernels[waysShift][blockShift - 2];
+}
+
+// Any geometry, one Cache::accessBlock per block number
+template <typename Policy, typename T>
+std::uint64_t runGenericBlocks(Cache<Policy> &cache, const T *blocks, std::size_t count, HitBitmap *bitmap)
+{
+    HitRecorder recorder(bitmap);
+    const std::size_t prefetchEnd = shouldPrefetch(cache) && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < prefetchEnd)
+            cache.prefetchBlock(blocks[i + kPrefetchDistance]);
+        recorder.record(i, cache.accessBlock(blocks[i]));
+    }
+    return recorder.finish(count);
+}
+
+// The loop over block numbers for this cache: a specialization for 1 to
+// 16 ways and a power-of-two set count, otherwise Cache::accessBlock
+template <typename Policy, typename T>
+KernelLoop<Policy, T> blocksKernelFor(const Cache<Policy> &cache)
+{
+    static constexpr std::array<KernelLoop<Policy, T>, 5> kernels = {
+        runKernel<Policy, T, 1, 0>, runKernel<Policy, T, 2, 0>, runKernel<Policy, T, 4, 0>, runKernel<Policy, T, 8, 0>, runKernel<Policy, T, 16, 0>};
+
+    int waysShift = log2IfPowerOfTwo(cache.getAssociativity());
+    if (waysShift < 0 || waysShift >= 5 || log2IfPowerOfTwo(cache.getSets()) < 0)
+        return runGenericBlocks<Policy, T>;
+
+#ifdef TAG_MATCH_AVX2
+    static constexpr std::array<KernelLoop<Policy, T>, 2> avx2Kernels = {runKernelAvx2<Policy, T, 8, 0>, runKernelAvx2<Policy, T, 16, 0>};
+    if (waysShift >= 3 && hasAvx2())
+        return avx2Kernels[waysShift - 3];
+#endif
+    return kernels[waysShift];
+}
+
+template <typename Policy>
+using RunsLoop = std::uint64_t (*)(Cache<Policy> &, const std::uint64_t *, const std::uint32_t *, std::size_t);
+
+template <typename Policy, int Ways>
+std::uint64_t runKernelRuns(Cache<Policy> &cache, const std::uint64_t *blocks, const std::uint32_t *counts, std::size_t count)
+{
+    CacheKernel<Policy, Ways, 0> kernel(cache);
+    const std::size_t prefetchEnd = shouldPrefetch(cache) && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+    std::uint64_t hits = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < prefetchEnd)
+            kernel.prefetch(blocks[i + kPrefetchDistance]);
+        hits += kernel.accessRun(blocks[i], counts[i]);
+    }
+    return hits;
+}
+
+#ifdef TAG_MATCH_AVX2
+template <typename Policy, int Ways>
+__attribute__((target("avx2"))) std::uint64_t runKernelRunsAvx2(Cache<Policy> &cache, const std::uint64_t *blocks, const std::uint32_t *counts, std::size_t count)
+{
+    CacheKernel<Policy, Ways, 0> kernel(cache);
+    const std::size_t prefetchEnd = shouldPrefetch(cache) && count > kPrefetchDistance ? count - kPrefetchDistance : 0;
+    std::uint64_t hits = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i < prefetchEnd)
+            kernel.prefetch(blocks[i + kPrefetchDistance]);
+        hits += kernel.accessRunAvx2(blocks[i], counts[i]);
+    }
+    return hits;
+}
+#endif
+
+template <typename Policy>
+std::uint64_t runGenericRuns(Cache<Policy> &cache, const std::uint64_t *blocks, const std::uint32_t *counts, std::size_t count)
+{
+    std::uint64_t hits = 0;
+    for (std::size_t i = 0; i < count; ++i)
+        hits += cache.accessRun(blocks[i], counts[i]);
+    return hits;
+}
+
+// The loop over run records for this cache: a specialization for 1 to 16
+// ways and a power-of-two set count, otherwise Cache::accessRun
+template <typename Policy>
+RunsLoop<Policy> runsKernelFor(const Cache<Policy> &cache)
+{
+    static constexpr std::array<RunsLoop<Policy>, 5> kernels = {
+        runKernelRuns<Policy, 1>, runKernelRuns<Policy, 2>, runKernelRuns<Policy, 4>, runKernelRuns<Policy, 8>, runKernelRuns<Policy, 16>};
+
+    int waysShift = log2IfPowerOfTwo(cache.getAssociativity());
+    if (waysShift < 0 || waysShift >= 5 || log2IfPowerOfTwo(cache.getSets()) < 0)
+        return runGenericRuns<Policy>;
+
+#ifdef TAG_MATCH_AVX2
+    static constexpr std::array<RunsLoop<Policy>, 2> avx2Kernels = {runKernelRunsAvx2<Policy, 8>, runKernelRunsAvx2<Policy, 16>};
+    if (waysShift >= 3 && hasAvx2())
+        return avx2Kernels[waysShift - 3];
+#endif
+    return kernels[waysShift];
+}
+
+// Simulates every access of runs [begin, end) in order and returns the
+// number of hits; the cache's block size must be the one the runs were
+// made for
+template <typename Policy>
+std::uint64_t accessRuns(Cache<Policy> &cache, const BlockRuns &runs, std::size_t begin, std::size_t end)
+{
+    return runsKernelFor(cache)(cache, runs.blocks.data() + begin, runs.counts.data() + begin, end - begin);
+}
+
+template <typename Policy>
+std::uint64_t accessRuns(Cache<Policy> &cache, const BlockRuns &runs)
+{
+    return accessRuns(cache, runs, 0, runs.size());
+}
+
+// Simulates accesses [begin, end) of the stream in order and returns the
+// number of hits; the cache's block size must be the one the stream was
+// made for
+template <typename Policy>
+std::uint64_t accessStream(Cache<Policy> &cache, const BlockStream &stream, std::size_t begin, std::size_t end)
+{
+    if (stream.isNarrow())
+        return blocksKernelFor<Policy, std::uint32_t>(cache)(cache, stream.narrow.data() + begin, end - begin, nullptr);
+    return blocksKernelFor<Policy, std::uint64_t>(cache)(cache, stream.wide.data() + begin, end - begin, nullptr);
+}
+
+template <typename Policy>
+std::uint64_t accessStream(Cache<Policy> &cache, const BlockStream &stream)
+{
+    return accessStream(cache, stream, 0, stream.size());
+}
+
+// Simulates `count` accesses in order and returns the number of hits. The
+// kernel is picked once for the whole batch.
+template <typename Policy, typename T>
+std::uint64_t accessAll(Cache<Policy> &cache, const T *addresses, std::size_t count)
+{
+    return kernelFor<Policy, T>(cache)(cache, addresses, count, nullptr);
+}
+
+// Like accessAll, and also records which accesses hit. Results are the
+// same as accessing one address at a time.
+template <typename Policy, typename T>
+std::uint64_t accessBatch(Cache<Policy> &cache, const T *addresses, std::size_t count, HitBitmap &hits)
+{
+    hits.reset(count);
+    return kernelFor<Policy, T>(cache)(cache, addresses, count, &hits);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PASS_REPLAY_H
+#define PASS_REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// N-pass replay of a trace through a cache that is never reset between
+// passes. Each pass starts in the state the one before it left behind,
+// so once a pass ends in exactly the state it started in, every later
+// pass starts there too and repeats it access for access. From that fixed
+// point on, passes are copied instead of simulated: a loop replayed a
+// thousand times costs as many passes as it takes the cache to settle.
+
+// Statistics of one pass over the trace
+struct PassStats
+{
+    std::uint64_t hits = 0;
+    std::uint64_t accesses = 0;
+    bool simulated = true; // false when copied from the fixed point
+
+    double hitRate() const { return accesses > 0 ? static_cast<double>(hits) / accesses : 0.0; }
+};
+
+// Runs `passes` passes through runPass(hits, accesses). After every pass
+// that has another after it, unchanged() says whether the cache ended the
+// pass in the state the previous call saw it in, and keeps the current
+// state for the next call; the first call has nothing to compare with and
+// says no. Returns the statistics of every
+// pass, and the number simulated in `simulated`.
+template <typename RunPass, typename Unchanged>
+std::vector<PassStats> runPasses(std::size_t passes, RunPass &&runPass, Unchanged &&unchanged, std::size_t &simulated)
+{
+    std::vector<PassStats> stats(passes);
+    simulated = 0;
+    for (std::size_t pass = 0; pass < passes; ++pass)
+    {
+        runPass(stats[pass].hits, stats[pass].accesses);
+        ++simulated;
+        if (pass + 1 < passes && unchanged())
+            break;
+    }
+
+    for (std::size_t pass = simulated; pass < passes; ++pass)
+    {
+        stats[pass] = stats[simulated - 1];
+        stats[pass].simulated = false;
+    }
+    return stats;
+}
+
+#endif
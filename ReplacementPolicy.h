@@ -0,0 +1,764 @@
+#ifndef REPLACEMENT_POLICY_H
+#define REPLACEMENT_POLICY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "AlignedArray.h"
+
+// Replacement policies plug into Cache<Policy> as a template parameter, so
+// the per-access path is resolved at compile time. Every policy provides:
+//
+//   Policy(int sets, int associativity, std::uint64_t seed);
+//   void reset();                                      // forget all history
+//   void resetSet(int set_index);                      // forget one set's history
+//   void resetShared();                                // forget state of no set
+//   void onHit(int set_index, int way);                // valid way referenced
+//   void onFill(int set_index, int way, bool was_valid); // way got a new block
+//   void onInvalidate(int set_index, int way);         // valid way lost its block
+//   int victim(int set_index);                         // way to evict, set full
+//   void prefetch(int set_index) const;                // set about to be used
+//   bool sameSet(const Policy &other, int set_index, SameWay sameWay) const;
+//                                                      // set would behave the same
+//   bool sameShared(const Policy &other) const;        // state of no set is the same
+//   static constexpr bool kSetLocal;                   // no state shared by sets
+//   static constexpr bool kIdempotentHits;             // onHit after onHit is a no-op
+//
+// Cache fills the lowest-numbered invalid way before it asks for a victim.
+// A way is invalidated only when a cache hierarchy takes its block away;
+// it then stays invalid until it is next filled.
+// resetSet of every set followed by resetShared is the same as reset.
+// A set-local policy keeps nothing but per-set state, so its sets can be
+// simulated independently of each other, in any interleaving. Under
+// idempotent hits, a second onHit of the way just hit changes nothing, so
+// a run of accesses to one block needs the policy for its first two.
+// sameSet is given sameWay(way, other_way), true where the two ways hold
+// the same block, and asks it about the pairs of ways it needs to match:
+// each way with itself where the policy's choices depend on way numbers,
+// or ways of the same rank where they do not. Two policies whose sets and
+// shared state compare the same make the same decisions from then on,
+// given the same accesses.
+
+// Whether sameWay holds for each of the first `ways` ways with itself
+template <typename SameWay>
+bool sameWays(int ways, SameWay &&sameWay)
+{
+    for (int way = 0; way < ways; ++way)
+    {
+        if (!sameWay(way, way))
+            return false;
+    }
+    return true;
+}
+
+// Small, fast, seedable generator shared by the randomized policies
+class SplitMix64
+{
+private:
+    std::uint64_t state;
+
+public:
+    explicit SplitMix64(std::uint64_t seed = 1) : state(seed) {}
+
+    std::uint64_t next()
+    {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    bool operator==(const SplitMix64 &other) const { return state == other.state; }
+
+    // Uniform value in [0, bound)
+    std::uint32_t below(std::uint32_t bound)
+    {
+        return static_cast<std::uint32_t>(((next() >> 32) * bound) >> 32);
+    }
+};
+
+// Per-set doubly-linked list threaded through the ways, head first
+class RecencyList
+{
+private:
+    static constexpr std::uint16_t kNone = 0xFFFF;
+
+    struct Link
+    {
+        std::uint16_t prev;
+        std::uint16_t next;
+    };
+
+    struct List
+    {
+        std::uint16_t head;
+        std::uint16_t tail;
+    };
+
+    int associativity = 0;
+    AlignedArray<Link> links; // sets * associativity, set-major
+    AlignedArray<List> lists; // one per set
+
+public:
+    RecencyList() = default;
+
+    RecencyList(int sets, int associativity) : associativity(associativity), links(static_cast<std::size_t>(sets) * associativity), lists(sets)
+    {
+        if (associativity >= kNone)
+            throw std::invalid_argument("associativity too large for a recency list");
+        reset();
+    }
+
+    void reset()
+    {
+        // Empty lists; links are rewritten when a way is inserted
+        lists.fill(List{kNone, kNone});
+    }
+
+    void resetSet(int set_index) { lists[set_index] = List{kNone, kNone}; }
+
+    void prefetch(int set_index) const
+    {
+        prefetchLine(links.get() + static_cast<std::size_t>(set_index) * associativity);
+        prefetchLine(lists.get() + set_index);
+    }
+
+    int head(int set_index) const { return lists[set_index].head; }
+    int tail(int set_index) const { return lists[set_index].tail; }
+
+    // Whether both lists of the set are as long and sameWay holds for the
+    // ways at every position; links of ways off the list are never read
+    template <typename SameWay>
+    bool sameOrder(const RecencyList &other, int set_index, SameWay &&sameWay) const
+    {
+        const Link *l = linksOf(set_index);
+        const Link *o = other.linksOf(set_index);
+        std::uint16_t a = lists[set_index].head;
+        std::uint16_t b = other.lists[set_index].head;
+        while (a != kNone && b != kNone)
+        {
+            if (!sameWay(a, b))
+                return false;
+            a = l[a].next;
+            b = o[b].next;
+        }
+        return a == b;
+    }
+
+    void unlink(int set_index, int way)
+    {
+        Link *l = linksOf(set_index);
+        List &list = lists[set_index];
+        std::uint16_t prev = l[way].prev;
+        std::uint16_t next = l[way].next;
+        if (prev != kNone)
+            l[prev].next = next;
+        else
+            list.head = next;
+        if (next != kNone)
+            l[next].prev = prev;
+        else
+            list.tail = prev;
+    }
+
+    void pushFront(int set_index, int way)
+    {
+        Link *l = linksOf(set_index);
+        List &list = lists[set_index];
+        l[way].prev = kNone;
+        l[way].next = list.head;
+        if (list.head != kNone)
+            l[list.head].prev = static_cast<std::uint16_t>(way);
+        else
+            list.tail = static_cast<std::uint16_t>(way);
+        list.head = static_cast<std::uint16_t>(way);
+    }
+
+private:
+    Link *linksOf(int set_index) { return links.get() + static_cast<std::size_t>(set_index) * associativity; }
+    const Link *linksOf(int set_index) const { return links.get() + static_cast<std::size_t>(set_index) * associativity; }
+};
+
+// True LRU replacement with constant work per access.
+// The recency list keeps the most recently used way at the head. Since
+// invalid ways are filled before anything is evicted, the tail is exactly
+// the way the old counter-per-way scheme would have picked as its victim.
+class LruPolicy
+{
+private:
+    RecencyList order;
+
+public:
+    static constexpr bool kSetLocal = true;
+    static constexpr bool kIdempotentHits = true;
+
+    LruPolicy() = default;
+    LruPolicy(int sets, int associativity, std::uint64_t) : order(sets, associativity) {}
+
+    void reset() { order.reset(); }
+    void resetSet(int set_index) { order.resetSet(set_index); }
+    void resetShared() {}
+
+    void onHit(int set_index, int way)
+    {
+        if (order.head(set_index) == way)
+            return;
+        order.unlink(set_index, way);
+        order.pushFront(set_index, way);
+    }
+
+    void onFill(int set_index, int way, bool was_valid)
+    {
+        if (was_valid)
+            order.unlink(set_index, way);
+        order.pushFront(set_index, way);
+    }
+
+    void onInvalidate(int set_index, int way) { order.unlink(set_index, way); }
+
+    int victim(int set_index) { return order.tail(set_index); }
+    void prefetch(int set_index) const { order.prefetch(set_index); }
+
+    // Only the order of the blocks matters, not the ways they are in
+    template <typename SameWay>
+    bool sameSet(const LruPolicy &other, int set_index, SameWay &&sameWay) const { return order.sameOrder(other.order, set_index, sameWay); }
+    bool sameShared(const LruPolicy &) const { return true; }
+};
+
+// First in, first out: hits do not change the eviction order
+class FifoPolicy
+{
+private:
+    RecencyList order;
+
+public:
+    static constexpr bool kSetLocal = true;
+    static constexpr bool kIdempotentHits = true;
+
+    FifoPolicy() = default;
+    FifoPolicy(int sets, int associativity, std::uint64_t) : order(sets, associativity) {}
+
+    void reset() { order.reset(); }
+    void resetSet(int set_index) { order.resetSet(set_index); }
+    void resetShared() {}
+
+    void onHit(int, int) {}
+
+    void onFill(int set_index, int way, bool was_valid)
+    {
+        if (was_valid)
+            order.unlink(set_index, way);
+        order.pushFront(set_index, way);
+    }
+
+    void onInvalidate(int set_index, int way) { order.unlink(set_index, way); }
+
+    int victim(int set_index) { return order.tail(set_index); }
+    void prefetch(int set_index) const { order.prefetch(set_index); }
+
+    // Only the order of the blocks matters, not the ways they are in
+    template <typename SameWay>
+    bool sameSet(const FifoPolicy &other, int set_index, SameWay &&sameWay) const { return order.sameOrder(other.order, set_index, sameWay); }
+    bool sameShared(const FifoPolicy &) const { return true; }
+};
+
+// Uniformly random victim from a seeded generator
+class RandomPolicy
+{
+private:
+    int associativity = 0;
+    std::uint64_t seed = 1;
+    SplitMix64 rng;
+
+public:
+    static constexpr bool kSetLocal = false; // one generator serves every set
+    static constexpr bool kIdempotentHits = true;
+
+    RandomPolicy() = default;
+    RandomPolicy(int, int associativity, std::uint64_t seed) : associativity(associativity), seed(seed), rng(seed) {}
+
+    void reset() { resetShared(); }
+    void resetSet(int) {}
+    void resetShared() { rng = SplitMix64(seed); }
+
+    void onHit(int, int) {}
+    void onFill(int, int, bool) {}
+    void onInvalidate(int, int) {}
+
+    int victim(int) { return static_cast<int>(rng.below(static_cast<std::uint32_t>(associativity))); }
+    void prefetch(int) const {}
+
+    template <typename SameWay>
+    bool sameSet(const RandomPolicy &, int, SameWay &&sameWay) const { return sameWays(associativity, sameWay); }
+    bool sameShared(const RandomPolicy &other) const { return rng == other.rng; }
+};
+
+// Tree pseudo-LRU: a binary tree of associativity - 1 direction bits per
+// set, each pointing away from the most recently used half below it.
+// Requires a power-of-two associativity of at most 64.
+class TreePlruPolicy
+{
+private:
+    int associativity = 0;
+    AlignedArray<std::uint64_t> bits; // one tree per set, node n at bit n - 1
+
+public:
+    static constexpr bool kSetLocal = true;
+    static constexpr bool kIdempotentHits = true;
+
+    TreePlruPolicy() = default;
+
+    TreePlruPolicy(int sets, int associativity, std::uint64_t) : associativity(associativity), bits(sets)
+    {
+        if (associativity > 64 || (associativity & (associativity - 1)) != 0)
+            throw std::invalid_argument("tree PLRU needs a power-of-two associativity up to 64");
+        reset();
+    }
+
+    void reset() { bits.fill(0); }
+    void resetSet(int set_index) { bits[set_index] = 0; }
+    void resetShared() {}
+
+    void onHit(int set_index, int way) { touch(set_index, way); }
+    void onFill(int set_index, int way, bool) { touch(set_index, way); }
+    void onInvalidate(int, int) {} // an invalid way is filled before any victim is chosen
+    void prefetch(int set_index) const { prefetchLine(bits.get() + set_index); }
+
+    template <typename SameWay>
+    bool sameSet(const TreePlruPolicy &other, int set_index, SameWay &&sameWay) const
+    {
+        return bits[set_index] == other.bits[set_index] && sameWays(associativity, sameWay);
+    }
+    bool sameShared(const TreePlruPolicy &) const { return true; }
+
+    int victim(int set_index)
+    {
+        std::uint64_t tree = bits[set_index];
+        int node = 1;
+        while (node < associativity)
+            node = 2 * node + static_cast<int>((tree >> (node - 1)) & 1);
+        return node - associativity;
+    }
+
+private:
+    void touch(int set_index, int way)
+    {
+        std::uint64_t tree = bits[set_index];
+        int node = 1;
+        for (int half = associativity / 2; half > 0; half /= 2)
+        {
+            bool right = (way & half) != 0;
+            // Point the victim search at the other half
+            if (right)
+                tree &= ~(1ull << (node - 1));
+            else
+                tree |= 1ull << (node - 1);
+            node = 2 * node + (right ? 1 : 0);
+        }
+        bits[set_index] = tree;
+    }
+};
+
+// Bit pseudo-LRU (MRU bits): each way has a recently-used bit, cleared for
+// all other ways once every bit is set. The victim is the lowest way whose
+// bit is clear. Requires an associativity of at most 64.
+class BitPlruPolicy
+{
+private:
+    int associativity = 0;
+    std::uint64_t full = 0;
+    AlignedArray<std::uint64_t> bits; // one mask per set
+
+public:
+    static constexpr bool kSetLocal = true;
+    static constexpr bool kIdempotentHits = true;
+
+    BitPlruPolicy() = default;
+
+    BitPlruPolicy(int sets, int associativity, std::uint64_t) : associativity(associativity), bits(sets)
+    {
+        if (associativity > 64)
+            throw std::invalid_argument("bit PLRU needs an associativity up to 64");
+        full = associativity == 64 ? ~0ull : (1ull << associativity) - 1;
+        reset();
+    }
+
+    void reset() { bits.fill(0); }
+    void resetSet(int set_index) { bits[set_index] = 0; }
+    void resetShared() {}
+
+    void onHit(int set_index, int way) { touch(set_index, way); }
+    void onFill(int set_index, int way, bool) { touch(set_index, way); }
+    void onInvalidate(int set_index, int way) { bits[set_index] &= ~(1ull << way); }
+    void prefetch(int set_index) const { prefetchLine(bits.get() + set_index); }
+
+    template <typename SameWay>
+    bool sameSet(const BitPlruPolicy &other, int set_index, SameWay &&sameWay) const
+    {
+        return bits[set_index] == other.bits[set_index] && sameWays(associativity, sameWay);
+    }
+    bool sameShared(const BitPlruPolicy &) const { return true; }
+
+    int victim(int set_index)
+    {
+        std::uint64_t clear = ~bits[set_index] & full;
+        if (clear == 0)
+            return 0; // direct-mapped: the only bit is always set
+        int way = 0;
+        while (((clear >> way) & 1) == 0)
+            ++way;
+        return way;
+    }
+
+private:
+    void touch(int set_index, int way)
+    {
+        std::uint64_t mask = bits[set_index] | (1ull << way);
+        bits[set_index] = mask == full ? (1ull << way) : mask;
+    }
+};
+
+// Least frequently used: evicts the way with the fewest references since
+// it was filled, lowest way first on ties
+class LfuPolicy
+{
+private:
+    int associativity = 0;
+    AlignedArray<std::uint32_t> counts; // sets * associativity, set-major
+
+public:
+    static constexpr bool kSetLocal = true;
+    static constexpr bool kIdempotentHits = false; // every hit counts
+
+    LfuPolicy() = default;
+
+    LfuPolicy(int sets, int associativity, std::uint64_t) : associativity(associativity), counts(static_cast<std::size_t>(sets) * associativity)
+    {
+        reset();
+    }
+
+    void reset() { counts.fill(0); }
+    void resetSet(int set_index) { std::fill(countsOf(set_index), countsOf(set_index) + associativity, 0u); }
+    void resetShared() {}
+
+    void onHit(int set_index, int way) { ++countsOf(set_index)[way]; }
+    void onFill(int set_index, int way, bool) { countsOf(set_index)[way] = 1; }
+    void onInvalidate(int set_index, int way) { countsOf(set_index)[way] = 0; }
+    void prefetch(int set_index) const { prefetchLine(counts.get() + static_cast<std::size_t>(set_index) * associativity); }
+
+    template <typename SameWay>
+    bool sameSet(const LfuPolicy &other, int set_index, SameWay &&sameWay) const
+    {
+        return std::equal(countsOf(set_index), countsOf(set_index) + associativity, other.countsOf(set_index)) && sameWays(associativity, sameWay);
+    }
+
+    bool sameShared(const LfuPolicy &) const { return true; }
+
+    int victim(int set_index)
+    {
+        const std::uint32_t *c = countsOf(set_index);
+        int victim_index = 0;
+        for (int i = 1; i < associativity; ++i)
+        {
+            if (c[i] < c[victim_index])
+                victim_index = i;
+        }
+        return victim_index;
+    }
+
+private:
+    std::uint32_t *countsOf(int set_index) { return counts.get() + static_cast<std::size_t>(set_index) * associativity; }
+    const std::uint32_t *countsOf(int set_index) const { return counts.get() + static_cast<std::size_t>(set_index) * associativity; }
+};
+
+// Re-reference interval prediction state shared by the RRIP family
+// (Jaleel et al., ISCA 2010): a 2-bit re-reference prediction value per
+// way, 0 for "soon" up to kDistant for "far in the future".
+class RripState
+{
+public:
+    static constexpr std::uint8_t kDistant = 3;
+    static constexpr std::uint8_t kLong = kDistant - 1;
+
+private:
+    int associativity = 0;
+    AlignedArray<std::uint8_t> rrpv; // sets * associativity, set-major
+
+public:
+    RripState() = default;
+
+    RripState(int sets, int associativity) : associativity(associativity), rrpv(static_cast<std::size_t>(sets) * associativity)
+    {
+        reset();
+    }
+
+    void reset() { rrpv.fill(kDistant); }
+    void resetSet(int set_index) { std::fill(rrpvOf(set_index), rrpvOf(set_index) + associativity, kDistant); }
+
+    void set(int set_index, int way, std::uint8_t value) { rrpvOf(set_index)[way] = value; }
+    void prefetch(int set_index) const { prefetchLine(rrpv.get() + static_cast<std::size_t>(set_index) * associativity); }
+
+    template <typename SameWay>
+    bool sameSet(const RripState &other, int set_index, SameWay &&sameWay) const
+    {
+        return std::equal(rrpvOf(set_index), rrpvOf(set_index) + associativity, other.rrpvOf(set_index)) && sameWays(associativity, sameWay);
+    }
+
+    // First way predicted distant, ageing the whole set until one is
+    int victim(int set_index)
+    {
+        std::uint8_t *r = rrpvOf(set_index);
+        std::uint8_t oldest = 0;
+        for (int i = 0; i < associativity; ++i)
+        {
+            if (r[i] == kDistant)
+                return i;
+            oldest = std::max(oldest, r[i]);
+        }
+
+        std::uint8_t step = kDistant - oldest;
+        int victim_index = -1;
+        for (int i = 0; i < associativity; ++i)
+        {
+            r[i] += step;
+            if (r[i] == kDistant && victim_index < 0)
+                victim_index = i;
+        }
+        return victim_index;
+    }
+
+private:
+    std::uint8_t *rrpvOf(int set_index) { return rrpv.get() + static_cast<std::size_t>(set_index) * associativity; }
+    const std::uint8_t *rrpvOf(int set_index) const { return rrpv.get() + static_cast<std::size_t>(set_index) * associativity; }
+};
+
+// Static RRIP: new blocks are predicted a long re-reference interval
+class SrripPolicy
+{
+private:
+    RripState state;
+
+public:
+    static constexpr bool kSetLocal = true;
+    static constexpr bool kIdempotentHits = true;
+
+    SrripPolicy() = default;
+    SrripPolicy(int sets, int associativity, std::uint64_t) : state(sets, associativity) {}
+
+    void reset() { state.reset(); }
+    void resetSet(int set_index) { state.resetSet(set_index); }
+    void resetShared() {}
+
+    void onHit(int set_index, int way) { state.set(set_index, way, 0); }
+    void onFill(int set_index, int way, bool) { state.set(set_index, way, RripState::kLong); }
+
+    void onInvalidate(int set_index, int way) { state.set(set_index, way, RripState::kDistant); }
+
+    int victim(int set_index) { return state.victim(set_index); }
+    void prefetch(int set_index) const { state.prefetch(set_index); }
+
+    template <typename SameWay>
+    bool sameSet(const SrripPolicy &other, int set_index, SameWay &&sameWay) const { return state.sameSet(other.state, set_index, sameWay); }
+    bool sameShared(const SrripPolicy &) const { return true; }
+};
+
+// Bimodal RRIP: new blocks are predicted distant, except for one fill in
+// kBimodalThrottle which is predicted long
+class BrripPolicy
+{
+private:
+    static constexpr std::uint32_t kBimodalThrottle = 32;
+
+    std::uint64_t seed = 1;
+    SplitMix64 rng;
+    RripState state;
+
+public:
+    static constexpr bool kSetLocal = false; // one generator serves every set
+    static constexpr bool kIdempotentHits = true;
+
+    BrripPolicy() = default;
+    BrripPolicy(int sets, int associativity, std::uint64_t seed) : seed(seed), rng(seed), state(sets, associativity) {}
+
+    void reset()
+    {
+        state.reset();
+        resetShared();
+    }
+
+    void resetSet(int set_index) { state.resetSet(set_index); }
+    void resetShared() { rng = SplitMix64(seed); }
+
+    void onHit(int set_index, int way) { state.set(set_index, way, 0); }
+
+    void onFill(int set_index, int way, bool)
+    {
+        std::uint8_t value = rng.below(kBimodalThrottle) == 0 ? RripState::kLong : RripState::kDistant;
+        state.set(set_index, way, value);
+    }
+
+    void onInvalidate(int set_index, int way) { state.set(set_index, way, RripState::kDistant); }
+
+    int victim(int set_index) { return state.victim(set_index); }
+    void prefetch(int set_index) const { state.prefetch(set_index); }
+
+    template <typename SameWay>
+    bool sameSet(const BrripPolicy &other, int set_index, SameWay &&sameWay) const { return state.sameSet(other.state, set_index, sameWay); }
+    bool sameShared(const BrripPolicy &other) const { return rng == other.rng; }
+};
+
+// Dynamic RRIP: set dueling between SRRIP and BRRIP. In every group of
+// sets one leader always uses SRRIP and another always uses BRRIP; misses
+// in the leaders steer a saturating selector that the followers obey.
+// A single-set cache has no BRRIP leader and so behaves as SRRIP.
+class DrripPolicy
+{
+private:
+    static constexpr std::uint32_t kBimodalThrottle = 32;
+    static constexpr int kLeaderGroups = 32;
+    static constexpr int kSelectorMax = 1023; // 10-bit saturating counter
+
+    int group_size = 2;
+    int selector = kSelectorMax / 2;
+    std::uint64_t seed = 1;
+    SplitMix64 rng;
+    RripState state;
+
+public:
+    static constexpr bool kSetLocal = false; // the selector is shared by every set
+    static constexpr bool kIdempotentHits = true;
+
+    DrripPolicy() = default;
+
+    DrripPolicy(int sets, int associativity, std::uint64_t seed) : group_size(std::max(2, sets / kLeaderGroups)), seed(seed), rng(seed), state(sets, associativity)
+    {
+    }
+
+    void reset()
+    {
+        state.reset();
+        resetShared();
+    }
+
+    void resetSet(int set_index) { state.resetSet(set_index); }
+
+    void resetShared()
+    {
+        selector = kSelectorMax / 2;
+        rng = SplitMix64(seed);
+    }
+
+    void onHit(int set_index, int way) { state.set(set_index, way, 0); }
+
+    void onFill(int set_index, int way, bool)
+    {
+        int offset = set_index % group_size;
+        bool bimodal;
+        if (offset == 0)
+        {
+            // SRRIP leader missed: favour BRRIP
+            selector = std::min(selector + 1, kSelectorMax);
+            bimodal = false;
+        }
+        else if (offset == group_size / 2)
+        {
+            // BRRIP leader missed: favour SRRIP
+            selector = std::max(selector - 1, 0);
+            bimodal = true;
+        }
+        else
+        {
+            bimodal = selector > kSelectorMax / 2;
+        }
+
+        std::uint8_t value = RripState::kLong;
+        if (bimodal && rng.below(kBimodalThrottle) != 0)
+            value = RripState::kDistant;
+        state.set(set_index, way, value);
+    }
+
+    void onInvalidate(int set_index, int way) { state.set(set_index, way, RripState::kDistant); }
+
+    int victim(int set_index) { return state.victim(set_index); }
+    void prefetch(int set_index) const { state.prefetch(set_index); }
+
+    template <typename SameWay>
+    bool sameSet(const DrripPolicy &other, int set_index, SameWay &&sameWay) const { return state.sameSet(other.state, set_index, sameWay); }
+    bool sameShared(const DrripPolicy &other) const { return selector == other.selector && rng == other.rng; }
+};
+
+enum class PolicyKind
+{
+    Lru,
+    Fifo,
+    Random,
+    TreePlru,
+    BitPlru,
+    Lfu,
+    Srrip,
+    Brrip,
+    Drrip
+};
+
+// Command-line name of every policy, in PolicyKind order
+inline const char *const *policyNames()
+{
+    static const char *const names[] = {"lru", "fifo", "random", "plru", "bitplru", "lfu", "srrip", "brrip", "drrip", nullptr};
+    return names;
+}
+
+inline PolicyKind parsePolicyKind(const std::string &name)
+{
+    const char *const *names = policyNames();
+    for (int i = 0; names[i] != nullptr; ++i)
+    {
+        if (name == names[i])
+            return static_cast<PolicyKind>(i);
+    }
+    throw std::invalid_argument("unknown replacement policy '" + name + "'");
+}
+
+inline const char *policyName(PolicyKind kind)
+{
+    return policyNames()[static_cast<int>(kind)];
+}
+
+// Carries a policy type into a generic lambda
+template <typename Policy>
+struct PolicyTag
+{
+    using type = Policy;
+};
+
+// Calls fn(PolicyTag<P>{}) with the policy type selected at run time, so
+// everything fn instantiates is specialized for that policy
+template <typename Fn>
+decltype(auto) withPolicy(PolicyKind kind, Fn &&fn)
+{
+    switch (kind)
+    {
+    case PolicyKind::Fifo:
+        return fn(PolicyTag<FifoPolicy>{});
+    case PolicyKind::Random:
+        return fn(PolicyTag<RandomPolicy>{});
+    case PolicyKind::TreePlru:
+        return fn(PolicyTag<TreePlruPolicy>{});
+    case PolicyKind::BitPlru:
+        return fn(PolicyTag<BitPlruPolicy>{});
+    case PolicyKind::Lfu:
+        return fn(PolicyTag<LfuPolicy>{});
+    case PolicyKind::Srrip:
+        return fn(PolicyTag<SrripPolicy>{});
+    case PolicyKind::Brrip:
+        return fn(PolicyTag<BrripPolicy>{});
+    case PolicyKind::Drrip:
+        return fn(PolicyTag<DrripPolicy>{});
+    case PolicyKind::Lru:
+    default:
+        return fn(PolicyTag<LruPolicy>{});
+    }
+}
+
+#endif
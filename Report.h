@@ -0,0 +1,202 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Summary reporting. Simulation only fills counters; what the user sees is
+// collected here as labelled lines of fields and written once at the end,
+// as text for people, one CSV record or one JSON object, in a single
+// buffered write.
+
+enum class ReportFormat
+{
+    Human,
+    Csv,
+    Json
+};
+
+inline ReportFormat parseReportFormat(const std::string &name)
+{
+    if (name == "human")
+        return ReportFormat::Human;
+    if (name == "csv")
+        return ReportFormat::Csv;
+    if (name == "json")
+        return ReportFormat::Json;
+    throw std::invalid_argument("unknown report format " + name);
+}
+
+class Report
+{
+private:
+    struct Field
+    {
+        std::string label;
+        std::string value;
+        bool number;
+    };
+
+    // "Label - Field: value, Field: value" in human form
+    struct Line
+    {
+        std::string label;
+        std::vector<Field> fields;
+    };
+
+    std::vector<std::string> banner;
+    std::vector<Line> lines;
+
+public:
+    // Text shown above the statistics in human form only
+    void addBanner(const std::string &text) { banner.push_back(text); }
+
+    // Starts a line of fields; an empty label puts the fields on their own
+    Report &line(const std::string &label)
+    {
+        lines.push_back(Line{label, {}});
+        return *this;
+    }
+
+    Report &field(const std::string &label, std::uint64_t value) { return add(label, std::to_string(value), true); }
+    Report &field(const std::string &label, std::int64_t value) { return add(label, std::to_string(value), true); }
+
+    // Other unsigned counts, such as std::size_t where it is not
+    // std::uint64_t, which would be ambiguous between the two above
+    template <typename T, std::enable_if_t<std::is_unsigned<T>::value && !std::is_same<T, std::uint64_t>::value && !std::is_same<T, bool>::value, int> = 0>
+    Report &field(const std::string &label, T value)
+    {
+        return field(label, static_cast<std::uint64_t>(value));
+    }
+
+    Report &field(const std::string &label, double value)
+    {
+        std::ostringstream text;
+        text << value;
+        return add(label, text.str(), true);
+    }
+
+    Report &field(const std::string &label, const std::string &value) { return add(label, value, false); }
+
+    void write(std::ostream &out, ReportFormat format) const
+    {
+        std::ostringstream text;
+        if (format == ReportFormat::Human)
+            writeHuman(text);
+        else if (format == ReportFormat::Csv)
+            writeCsv(text);
+        else
+            writeJson(text);
+        out << text.str();
+        out.flush();
+    }
+
+private:
+    Report &add(const std::string &label, const std::string &value, bool number)
+    {
+        if (lines.empty())
+            lines.push_back(Line{});
+        lines.back().fields.push_back(Field{label, value, number});
+        return *this;
+    }
+
+    void writeHuman(std::ostream &out) const
+    {
+        for (const std::string &text : banner)
+            out << text << "\n";
+        for (const Line &line : lines)
+        {
+            if (!line.label.empty())
+                out << line.label << " - ";
+            for (std::size_t i = 0; i < line.fields.size(); ++i)
+                out << (i > 0 ? ", " : "") << line.fields[i].label << ": " << line.fields[i].value;
+            out << "\n";
+        }
+    }
+
+    // One header row of keys and one row of values
+    void writeCsv(std::ostream &out) const
+    {
+        std::ostringstream values;
+        bool first = true;
+        for (const Line &line : lines)
+        {
+            for (const Field &field : line.fields)
+            {
+                out << (first ? "" : ",") << key(line.label, field.label);
+                values << (first ? "" : ",") << (field.number ? field.value : csvQuoted(field.value));
+                first = false;
+            }
+        }
+        out << "\n"
+            << values.str() << "\n";
+    }
+
+    void writeJson(std::ostream &out) const
+    {
+        out << "{";
+        bool first = true;
+        for (const Line &line : lines)
+        {
+            for (const Field &field : line.fields)
+            {
+                out << (first ? "" : ", ") << "\"" << key(line.label, field.label) << "\": "
+                    << (field.number ? field.value : jsonQuoted(field.value));
+                first = false;
+            }
+        }
+        out << "}\n";
+    }
+
+    // Machine name of a field: its line and field labels in snake case
+    static std::string key(const std::string &line, const std::string &field)
+    {
+        std::string name;
+        for (char c : line.empty() ? field : line + " " + field)
+        {
+            bool alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            if (alnum)
+                name += static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+            else if (!name.empty() && name.back() != '_')
+                name += '_';
+        }
+        while (!name.empty() && name.back() == '_')
+            name.pop_back();
+        return name;
+    }
+
+    static std::string csvQuoted(const std::string &value)
+    {
+        if (value.find_first_of(",\"\n") == std::string::npos)
+            return value;
+        std::string quoted = "\"";
+        for (char c : value)
+            quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        return quoted + "\"";
+    }
+
+    static std::string jsonQuoted(const std::string &value)
+    {
+        std::string quoted = "\"";
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+                quoted += '\\';
+            if (c == '\n')
+            {
+                quoted += "\\n";
+                continue;
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+};
+
+#endif
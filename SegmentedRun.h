@@ -0,0 +1,116 @@
+#ifndef SEGMENTED_RUN_H
+#define SEGMENTED_RUN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Cache.h"
+#include "CacheKernel.h"
+#include "Sweep.h"
+#include "Trace.h"
+
+// Time-parallel simulation of one configuration. The first and second
+// runs are laid end to end as one stream of 2 * length accesses, which is
+// cut into contiguous segments that are simulated in parallel, each on a
+// cold cache. Before its own accesses every segment replays a warm-up
+// window of the accesses just before it without counting them, which
+// hides most of the cold start but not all of it. The first segment
+// starts cold in the serial run as well, so it is always exact.
+
+// First stream position of segment k of `segments`
+inline std::size_t segmentBegin(std::size_t total, std::size_t segments, std::size_t k)
+{
+    return total * k / segments;
+}
+
+// Replays positions [begin, end) of the two-run stream of `length`
+// addresses, counting every access towards the run it belongs to, or not
+// at all when result is null
+template <typename Policy>
+void replayRange(Cache<Policy> &cache, const Address *addresses, std::size_t length, std::size_t begin, std::size_t end, SweepResult *result)
+{
+    for (std::size_t p = begin; p < end;)
+    {
+        // Stay within one run so the trace index is a plain offset
+        std::size_t run = p / length;
+        std::size_t stop = std::min(end, (run + 1) * length);
+        std::uint64_t hits = accessAll(cache, addresses + (p - run * length), stop - p);
+
+        if (result != nullptr)
+        {
+            std::uint64_t &runHits = run == 0 ? result->hits1 : result->hits2;
+            std::uint64_t &runAccesses = run == 0 ? result->accesses1 : result->accesses2;
+            runHits += hits;
+            runAccesses += stop - p;
+            result->valid = true;
+        }
+        p = stop;
+    }
+}
+
+// Simulates the segments in parallel on `threads` workers, each after a
+// warm-up of up to `warmup` accesses. Returns the statistics of every
+// segment; they add up to the statistics of the whole run.
+template <typename Policy>
+std::vector<SweepResult> runSegments(const Address *addresses, std::size_t length, const SweepConfig &config, std::size_t segments, std::size_t warmup,
+                                     unsigned threads, std::uint64_t seed)
+{
+    const std::size_t total = 2 * length;
+    segments = std::max<std::size_t>(1, std::min(segments, total));
+    std::vector<SweepResult> results(segments);
+
+    // Reject a bad geometry before any worker starts
+    Cache<Policy> check(config.size, config.associativity, config.block_size, seed);
+
+    // Segments are the same length, so each worker takes every workers-th
+    // one and reuses its cache, which resets in constant time
+    const std::size_t workers = std::min<std::size_t>(std::max(threads, 1u), segments);
+    parallelFor(workers, threads, [&](std::size_t worker)
+                {
+        Cache<Policy> cache(config.size, config.associativity, config.block_size, seed);
+        for (std::size_t k = worker; k < segments; k += workers)
+        {
+            std::size_t begin = segmentBegin(total, segments, k);
+            std::size_t end = segmentBegin(total, segments, k + 1);
+            cache.resetCacheState();
+            replayRange(cache, addresses, length, begin - std::min(begin, warmup), begin, nullptr);
+            replayRange(cache, addresses, length, begin, end, &results[k]);
+        } });
+
+    return results;
+}
+
+// Serial reference for runSegments: one cache replays the whole stream
+// and the statistics are split at the same segment boundaries
+template <typename Policy>
+std::vector<SweepResult> serialSegments(const Address *addresses, std::size_t length, const SweepConfig &config, std::size_t segments, std::uint64_t seed)
+{
+    const std::size_t total = 2 * length;
+    segments = std::max<std::size_t>(1, std::min(segments, total));
+    std::vector<SweepResult> results(segments);
+
+    Cache<Policy> cache(config.size, config.associativity, config.block_size, seed);
+    for (std::size_t k = 0; k < segments; ++k)
+        replayRange(cache, addresses, length, segmentBegin(total, segments, k), segmentBegin(total, segments, k + 1), &results[k]);
+
+    return results;
+}
+
+// Sum of the statistics of all segments
+inline SweepResult combineSegments(const std::vector<SweepResult> &segments)
+{
+    SweepResult total;
+    total.valid = true;
+    for (const SweepResult &segment : segments)
+    {
+        total.hits1 += segment.hits1;
+        total.accesses1 += segment.accesses1;
+        total.hits2 += segment.hits2;
+        total.accesses2 += segment.accesses2;
+    }
+    return total;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef SHARDED_CACHE_H
+#define SHARDED_CACHE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Cache.h"
+#include "CacheKernel.h"
+#include "Trace.h"
+#include "TraceSource.h"
+
+// Set-sharded simulation of one cache configuration. Under a set-local
+// policy the sets never interact, so they are dealt out to shards that
+// each own a disjoint slice of the tag store and run on their own thread;
+// every hit and miss is exactly what the serial simulation gives.
+//
+// Shard s owns the sets whose index is s modulo the shard count. It is
+// simulated as a cache with sets / shards sets fed block b / shards, which
+// lands in set (b % sets) / shards with the same tag b / sets.
+
+// Number of shards for `sets` sets on up to `threads` threads: the largest
+// divisor of the set count that is not above the thread count
+inline int shardCount(int sets, unsigned threads)
+{
+    int shards = static_cast<int>(std::min<unsigned>(std::max(threads, 1u), static_cast<unsigned>(sets)));
+    while (sets % shards != 0)
+        --shards;
+    return shards;
+}
+
+// Bounded queue of address batches from one producer to one consumer. An
+// empty batch marks the end of a pass.
+class BatchQueue
+{
+private:
+    static constexpr std::size_t kCapacity = 8;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<Address>> batches;
+
+public:
+    void push(std::vector<Address> batch)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]
+                     { return batches.size() < kCapacity; });
+        batches.push_back(std::move(batch));
+        changed.notify_all();
+    }
+
+    std::vector<Address> pop()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]
+                     { return !batches.empty(); });
+        std::vector<Address> batch = std::move(batches.front());
+        batches.pop_front();
+        changed.notify_all();
+        return batch;
+    }
+};
+
+template <typename Policy>
+class ShardedCache
+{
+private:
+    // Addresses handed to a shard at a time
+    static constexpr std::size_t kBatchSize = 16384;
+
+    int block_size;
+    int sets;
+    int shards;
+    std::vector<std::unique_ptr<Cache<Policy>>> caches; // one per shard
+
+public:
+    ShardedCache(int size, int associativity, int block_size, unsigned threads, std::uint64_t seed = 1) : block_size(block_size)
+    {
+        static_assert(Policy::kSetLocal, "set sharding needs a set-local replacement policy");
+
+        // Validates the geometry and gives the set count
+        Cache<Policy> whole(size, associativity, block_size, seed);
+        sets = whole.getSets();
+        shards = shardCount(sets, threads);
+
+        int shard_size = sets / shards * associativity * block_size;
+        for (int s = 0; s < shards; ++s)
+            caches.push_back(std::make_unique<Cache<Policy>>(shard_size, associativity, block_size, seed));
+    }
+
+    int getShards() const { return shards; }
+
+    // Copies of every shard, for sameState
+    std::vector<Cache<Policy>> snapshot() const
+    {
+        std::vector<Cache<Policy>> copies;
+        for (const auto &cache : caches)
+            copies.push_back(*cache);
+        return copies;
+    }
+
+    // Whether every shard is in the state of its copy in the snapshot
+    bool sameState(const std::vector<Cache<Policy>> &copies) const
+    {
+        for (int s = 0; s < shards; ++s)
+        {
+            if (!caches[s]->sameState(copies[s]))
+                return false;
+        }
+        return true;
+    }
+
+    // Replays the filtered trace once across all shards and adds up the
+    // hits and accesses
+    void runPass(const TraceSource &source, std::uint64_t &hits, std::uint64_t &accesses)
+    {
+        std::vector<BatchQueue> queues(shards);
+        std::vector<std::uint64_t> shardHits(shards, 0);
+
+        std::vector<std::thread> workers;
+        for (int s = 0; s < shards; ++s)
+        {
+            workers.emplace_back([&, s]()
+                                 {
+                Cache<Policy> &cache = *caches[s];
+                std::uint64_t count = 0;
+                for (std::vector<Address> batch = queues[s].pop(); !batch.empty(); batch = queues[s].pop())
+                    count += accessAll(cache, batch.data(), batch.size());
+                shardHits[s] = count; });
+        }
+
+        // Deal the addresses out; a decoding error still has to stop the
+        // workers before it propagates
+        std::exception_ptr failure;
+        std::vector<std::vector<Address>> pending(shards);
+        try
+        {
+            const std::uint64_t block = static_cast<std::uint64_t>(block_size);
+            const std::uint64_t count = static_cast<std::uint64_t>(shards);
+            source.replay([&](const Address *addresses, std::size_t length)
+                          {
+                for (std::size_t i = 0; i < length; ++i)
+                {
+                    // Same block mapping as Cache::access
+                    std::uint64_t b = addresses[i] / block;
+                    std::vector<Address> &batch = pending[b % count];
+                    batch.push_back(b / count * block);
+                    if (batch.size() == kBatchSize)
+                    {
+                        queues[b % count].push(std::move(batch));
+                        batch = std::vector<Address>();
+                        batch.reserve(kBatchSize);
+                    }
+                    accesses++;
+                }
+                return true; });
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+
+        for (int s = 0; s < shards; ++s)
+        {
+            if (!pending[s].empty())
+                queues[s].push(std::move(pending[s]));
+            queues[s].push(std::vector<Address>());
+        }
+        for (std::thread &worker : workers)
+            worker.join();
+
+        if (failure)
+            std::rethrow_exception(failure);
+        for (std::uint64_t h : shardHits)
+            hits += h;
+    }
+};
+
+#endif
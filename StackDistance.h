@@ -0,0 +1,285 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Sweep.h"
+#include "Trace.h"
+
+// LRU stack-distance (Mattson) analysis. Under LRU a set of any
+// associativity holds exactly the blocks with the smallest stack distance,
+// so one pass over the trace for a given block size and set count yields
+// the hit count of every associativity, and hence of every cache size
+// sharing that set count.
+
+// Largest associativity analysed with a bounded recency stack; deeper
+// stacks use the Fenwick tree
+constexpr int kBoundedStackWays = 32;
+
+// Histogram of per-set stack distances for each replay of the trace
+struct StackDistanceHistogram
+{
+    int passes = 0;
+    int max_ways = 0;
+    // counts[pass][d] is the number of accesses at stack distance d, for
+    // d < max_ways; longer distances and cold misses are not recorded
+    std::vector<std::vector<std::uint64_t>> counts;
+    std::vector<std::uint64_t> accesses;
+
+    // Hits of a cache with this associativity during the given pass
+    std::uint64_t hits(int pass, int associativity) const
+    {
+        std::uint64_t total = 0;
+        for (int d = 0; d < associativity && d < max_ways; ++d)
+            total += counts[pass][d];
+        return total;
+    }
+};
+
+// Links from every access to earlier accesses of the same block, for one
+// block size. They do not depend on the set count, so every set count
+// analysed at this block size shares them.
+struct ReuseLinks
+{
+    static constexpr std::uint32_t kNone = 0xFFFFFFFFu;
+
+    std::vector<std::uint64_t> blocks;   // block number of each access
+    std::vector<std::uint32_t> previous; // previous access to the block in the same pass, or kNone
+    std::vector<std::uint32_t> last;     // last access to the block anywhere in the pass
+
+    std::size_t size() const { return blocks.size(); }
+};
+
+// Finds the reuse links of the first `length` addresses by sorting
+// (block, position) keys, which stays cache-friendly on traces whose
+// footprint is far larger than any hash table would like
+inline ReuseLinks reuseLinks(const Address *addresses, std::size_t length, int block_size)
+{
+    if (length >= ReuseLinks::kNone)
+        throw std::invalid_argument("trace too long for stack distance analysis");
+
+    ReuseLinks links;
+    links.blocks.resize(length);
+    links.previous.resize(length);
+    links.last.resize(length);
+
+    // Block numbers take the full 64 bits, so the position rides alongside
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> keys(length);
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        // Same block mapping as Cache::access
+        links.blocks[i] = addresses[i] / static_cast<std::uint64_t>(block_size);
+        keys[i] = {links.blocks[i], static_cast<std::uint32_t>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    for (std::size_t first = 0; first < length;)
+    {
+        std::size_t end = first + 1;
+        while (end < length && keys[end].first == keys[first].first)
+            ++end;
+
+        std::uint32_t lastIndex = keys[end - 1].second;
+        std::uint32_t prev = ReuseLinks::kNone;
+        for (std::size_t k = first; k < end; ++k)
+        {
+            std::uint32_t i = keys[k].second;
+            links.previous[i] = prev;
+            links.last[i] = lastIndex;
+            prev = i;
+        }
+        first = end;
+    }
+
+    return links;
+}
+
+// Stack distances of `passes` back-to-back replays of the trace for one
+// set count. Each set keeps a Fenwick tree over its own access times in
+// which a time is marked while it is the latest access to its block; the
+// stack distance of an access is the number of marks since the previous
+// access to the same block, so every access costs O(log n).
+inline StackDistanceHistogram stackDistances(const ReuseLinks &links, int sets, int max_ways, int passes = 2)
+{
+    const std::size_t length = links.size();
+    StackDistanceHistogram histogram;
+    histogram.passes = passes;
+    histogram.max_ways = max_ways;
+    histogram.counts.assign(passes, std::vector<std::uint64_t>(max_ways, 0));
+    histogram.accesses.assign(passes, length);
+
+    // Position of every access among the accesses to its set in one pass
+    std::vector<std::uint32_t> setLength(sets, 0);
+    std::vector<std::uint32_t> local(length);
+    for (std::size_t i = 0; i < length; ++i)
+        local[i] = setLength[links.blocks[i] % static_cast<std::uint64_t>(sets)]++;
+
+    // Lay the per-set trees out back to back, each covering all passes
+    std::vector<std::size_t> base(sets + 1, 0);
+    for (int s = 0; s < sets; ++s)
+        base[s + 1] = base[s] + static_cast<std::size_t>(setLength[s]) * passes;
+    std::vector<std::uint32_t> tree(base[sets], 0);
+
+    auto add = [&](int s, std::size_t t, int delta)
+    {
+        std::uint32_t *f = tree.data() + base[s];
+        std::size_t n = base[s + 1] - base[s];
+        for (std::size_t i = t + 1; i <= n; i += i & (~i + 1))
+            f[i - 1] += delta;
+    };
+    auto prefix = [&](int s, std::size_t t) // marks at local times < t
+    {
+        const std::uint32_t *f = tree.data() + base[s];
+        std::uint32_t total = 0;
+        for (std::size_t i = t; i > 0; i -= i & (~i + 1))
+            total += f[i - 1];
+        return total;
+    };
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        std::vector<std::uint64_t> &counts = histogram.counts[pass];
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            int s = static_cast<int>(links.blocks[i] % static_cast<std::uint64_t>(sets));
+            std::size_t passStart = static_cast<std::size_t>(pass) * setLength[s];
+            std::size_t now = passStart + local[i];
+
+            // Previous access to this block: earlier in this pass, or its
+            // last access in the pass before
+            std::size_t then;
+            if (links.previous[i] != ReuseLinks::kNone)
+                then = passStart + local[links.previous[i]];
+            else if (pass > 0)
+                then = passStart - setLength[s] + local[links.last[i]];
+            else
+            {
+                add(s, now, 1);
+                continue;
+            }
+
+            std::uint32_t distance = prefix(s, now) - prefix(s, then + 1);
+            if (distance < static_cast<std::uint32_t>(max_ways))
+                ++counts[distance];
+            add(s, then, -1);
+            add(s, now, 1);
+        }
+    }
+
+    return histogram;
+}
+
+// Stack distances up to max_ways for one set count, from a recency stack
+// of the max_ways most recent blocks per set (move-to-front). This is
+// O(max_ways) per access with no reuse links, so for the small
+// associativities of a typical sweep it beats the Fenwick tree by a wide
+// margin; both give identical histograms.
+inline StackDistanceHistogram boundedStackDistances(const Address *addresses, std::size_t length, int block_size, int sets, int max_ways, int passes = 2)
+{
+    StackDistanceHistogram histogram;
+    histogram.passes = passes;
+    histogram.max_ways = max_ways;
+    histogram.counts.assign(passes, std::vector<std::uint64_t>(max_ways, 0));
+    histogram.accesses.assign(passes, length);
+
+    std::vector<std::uint64_t> stacks(static_cast<std::size_t>(sets) * max_ways);
+    std::vector<int> depth(sets, 0);
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        std::vector<std::uint64_t> &counts = histogram.counts[pass];
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            // Same block mapping as Cache::access
+            std::uint64_t block = addresses[i] / static_cast<std::uint64_t>(block_size);
+            int s = static_cast<int>(block % static_cast<std::uint64_t>(sets));
+            std::uint64_t *stack = stacks.data() + static_cast<std::size_t>(s) * max_ways;
+
+            int d = 0;
+            while (d < depth[s] && stack[d] != block)
+                ++d;
+            if (d < depth[s])
+                ++counts[d];
+            else if (depth[s] < max_ways)
+                d = depth[s]++;
+            else
+                d = max_ways - 1;
+
+            std::memmove(stack + 1, stack, d * sizeof(std::uint64_t));
+            stack[0] = block;
+        }
+    }
+
+    return histogram;
+}
+
+// Sweep results for LRU computed from stack distances instead of
+// simulation. Configurations are grouped by block size and set count;
+// each group needs one analysis pass, and the groups of one block size
+// run in parallel.
+inline std::vector<SweepResult> runStackDistanceSweep(const Trace &trace, std::size_t length, const std::vector<SweepConfig> &configs, unsigned threads)
+{
+    std::vector<SweepResult> results(configs.size());
+
+    // (block size, sets) -> largest associativity wanted
+    std::map<std::pair<int, int>, int> groups;
+    for (const SweepConfig &config : configs)
+    {
+        if (config.associativity <= 0 || config.block_size <= 0)
+            continue;
+        int sets = config.size / (config.associativity * config.block_size);
+        if (sets <= 0)
+            continue;
+        int &ways = groups[{config.block_size, sets}];
+        ways = std::max(ways, config.associativity);
+    }
+    // Reuse links are shared by every set count of a block size
+    for (auto group = groups.begin(); group != groups.end();)
+    {
+        int block_size = group->first.first;
+        std::vector<std::pair<int, int>> jobs; // (sets, largest associativity)
+        bool deep = false;
+        for (; group != groups.end() && group->first.first == block_size; ++group)
+        {
+            jobs.emplace_back(group->first.second, group->second);
+            deep = deep || group->second > kBoundedStackWays;
+        }
+
+        ReuseLinks links;
+        if (deep)
+            links = reuseLinks(trace.data(), length, block_size);
+
+        parallelFor(jobs.size(), threads, [&](std::size_t job)
+                    {
+            int sets = jobs[job].first;
+            int ways = jobs[job].second;
+            StackDistanceHistogram histogram = ways > kBoundedStackWays ? stackDistances(links, sets, ways)
+                                                                        : boundedStackDistances(trace.data(), length, block_size, sets, ways);
+
+            // Each result slot belongs to exactly one group
+            for (std::size_t i = 0; i < configs.size(); ++i)
+            {
+                const SweepConfig &config = configs[i];
+                if (config.block_size != block_size || config.associativity <= 0 ||
+                    config.size / (config.associativity * config.block_size) != sets)
+                    continue;
+                SweepResult &result = results[i];
+                result.valid = true;
+                result.hits1 = histogram.hits(0, config.associativity);
+                result.accesses1 = histogram.accesses[0];
+                result.hits2 = histogram.hits(1, config.associativity);
+                result.accesses2 = histogram.accesses[1];
+            } });
+    }
+
+    return results;
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockRuns.h"
+#include "BlockStream.h"
+#include "Cache.h"
+#include "CacheKernel.h"
+#include "Trace.h"
+
+// One cache geometry in a design-space sweep
+struct SweepConfig
+{
+    int size;
+    int associativity;
+    int block_size;
+};
+
+// Two-run statistics for one configuration
+struct SweepResult
+{
+    bool valid = false; // false when the geometry holds no complete set or
+                        // has an associativity the policy cannot model
+    std::uint64_t hits1 = 0;
+    std::uint64_t accesses1 = 0;
+    std::uint64_t hits2 = 0;
+    std::uint64_t accesses2 = 0;
+
+    double hitRate1() const { return accesses1 > 0 ? static_cast<double>(hits1) / accesses1 : 0.0; }
+    double hitRate2() const { return accesses2 > 0 ? static_cast<double>(hits2) / accesses2 : 0.0; }
+};
+
+// Number of worker threads to use when the caller does not say
+inline unsigned defaultThreadCount()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Runs fn(job) for every job in [0, jobs) on up to `threads` workers that
+// pull jobs from a shared counter. The first exception thrown by any job
+// is rethrown once all workers have stopped.
+template <typename Fn>
+void parallelFor(std::size_t jobs, unsigned threads, Fn &&fn)
+{
+    threads = static_cast<unsigned>(std::min<std::size_t>(std::max(threads, 1u), jobs));
+    if (threads <= 1)
+    {
+        for (std::size_t job = 0; job < jobs; ++job)
+            fn(job);
+        return;
+    }
+
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr failure;
+    std::mutex failureLock;
+
+    auto worker = [&]()
+    {
+        for (std::size_t job = next++; job < jobs; job = next++)
+        {
+            try
+            {
+                fn(job);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(failureLock);
+                if (!failure)
+                    failure = std::current_exception();
+                next = jobs;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t)
+        pool.emplace_back(worker);
+    for (std::thread &t : pool)
+        t.join();
+
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+// Every combination of the given sizes, associativities and block sizes
+inline std::vector<SweepConfig> sweepConfigs(const std::vector<int> &sizes, const std::vector<int> &ways, const std::vector<int> &blocks)
+{
+    std::vector<SweepConfig> configs;
+    for (int size : sizes)
+        for (int associativity : ways)
+            for (int block_size : blocks)
+                configs.push_back(SweepConfig{size, associativity, block_size});
+    return configs;
+}
+
+// Order in which a sweep walks its configurations and the trace
+enum class SweepOrder
+{
+    ConfigMajor, // each configuration over the whole trace in turn
+    ChunkMajor   // every configuration of a worker over each chunk in turn
+};
+
+// Bytes of block numbers or run records in one chunk of a chunk-major
+// sweep: small enough to stay in the host's L2 while every configuration
+// of a worker walks it
+constexpr std::size_t kSweepChunkBytes = std::size_t(128) << 10;
+
+inline SweepOrder parseSweepOrder(const std::string &name)
+{
+    if (name == "config")
+        return SweepOrder::ConfigMajor;
+    if (name == "chunk")
+        return SweepOrder::ChunkMajor;
+    throw std::invalid_argument("unknown sweep order " + name);
+}
+
+// Whether the policy can model an associativity; its constructor rejects
+// the ones it cannot, such as a non-power-of-two one under tree PLRU
+template <typename Policy>
+bool policyModels(int associativity)
+{
+    try
+    {
+        Policy(1, associativity, 1);
+        return true;
+    }
+    catch (const std::invalid_argument &)
+    {
+        return false;
+    }
+}
+
+// Simulates every configuration over the first `length` addresses of the
+// shared, read-only trace: a cold run then a warm run, as in main. The
+// configurations of one block size share the trace's same-block runs,
+// made once for them, when there are enough runs to pay for it, and
+// otherwise the trace's block numbers, so no configuration divides.
+// Configurations with no complete set, or with an associativity the policy
+// cannot model, are left invalid.
+//
+// In config-major order every configuration is a job of its own and reads
+// the whole trace. In chunk-major order each worker owns a group of
+// configurations and moves all of them through one chunk of the trace
+// before reading the next, so a worker reads the trace from memory once
+// per run while its configurations' tag stores stay in its caches.
+template <typename Policy>
+std::vector<SweepResult> runSweep(const Trace &trace, std::size_t length, const std::vector<SweepConfig> &configs, unsigned threads, std::uint64_t seed,
+                                  SweepOrder order = SweepOrder::ConfigMajor)
+{
+    std::vector<SweepResult> results(configs.size());
+    const Address *addresses = trace.data();
+
+    std::vector<int> blockSizes;
+    for (const SweepConfig &config : configs)
+    {
+        if (std::find(blockSizes.begin(), blockSizes.end(), config.block_size) == blockSizes.end())
+            blockSizes.push_back(config.block_size);
+    }
+
+    // One block size at a time, so only one set of runs or one stream is
+    // held at once
+    for (int block_size : blockSizes)
+    {
+        std::vector<std::size_t> jobs;
+        for (std::size_t i = 0; i < configs.size(); ++i)
+        {
+            const SweepConfig &config = configs[i];
+            if (config.block_size == block_size && config.associativity > 0 && config.block_size > 0 &&
+                config.size / (config.associativity * config.block_size) > 0 && policyModels<Policy>(config.associativity))
+                jobs.push_back(i);
+        }
+        if (jobs.empty())
+            continue;
+
+        BlockRuns runs;
+        const bool useRuns = coalesceRuns(addresses, length, block_size, runs);
+        BlockStream stream;
+        if (!useRuns)
+        {
+            runs = BlockRuns();
+            stream = blockStream(addresses, length, block_size);
+        }
+
+        // Simulates records [begin, end) of the runs or the stream
+        const std::size_t records = useRuns ? runs.size() : stream.size();
+        auto simulate = [&](Cache<Policy> &cache, std::size_t begin, std::size_t end)
+        {
+            return useRuns ? accessRuns(cache, runs, begin, end) : accessStream(cache, stream, begin, end);
+        };
+
+        if (order == SweepOrder::ConfigMajor)
+        {
+            parallelFor(jobs.size(), threads, [&](std::size_t job)
+                        {
+                const SweepConfig &config = configs[jobs[job]];
+                Cache<Policy> cache(config.size, config.associativity, config.block_size, seed);
+                SweepResult result;
+                result.valid = true;
+                result.hits1 = simulate(cache, 0, records);
+                result.accesses1 = length;
+                result.hits2 = simulate(cache, 0, records);
+                result.accesses2 = length;
+                results[jobs[job]] = result; });
+            continue;
+        }
+
+        const std::size_t recordBytes = useRuns ? sizeof(std::uint64_t) + sizeof(std::uint32_t)
+                                                : (stream.isNarrow() ? sizeof(std::uint32_t) : sizeof(std::uint64_t));
+        const std::size_t chunk = std::max<std::size_t>(kSweepChunkBytes / recordBytes, 1);
+
+        // Configurations are dealt round-robin, so every group mixes sizes
+        // and associativities and the groups take about as long
+        const std::size_t groups = std::min<std::size_t>(std::max(threads, 1u), jobs.size());
+        parallelFor(groups, threads, [&](std::size_t group)
+                    {
+            std::vector<std::size_t> owned;
+            std::vector<Cache<Policy>> caches;
+            for (std::size_t job = group; job < jobs.size(); job += groups)
+            {
+                const SweepConfig &config = configs[jobs[job]];
+                owned.push_back(jobs[job]);
+                caches.emplace_back(config.size, config.associativity, config.block_size, seed);
+            }
+
+            std::vector<SweepResult> own(owned.size());
+            for (int run = 0; run < 2; ++run)
+            {
+                for (std::size_t begin = 0; begin < records; begin += chunk)
+                {
+                    const std::size_t end = std::min(begin + chunk, records);
+                    for (std::size_t k = 0; k < caches.size(); ++k)
+                        (run == 0 ? own[k].hits1 : own[k].hits2) += simulate(caches[k], begin, end);
+                }
+            }
+
+            for (std::size_t k = 0; k < owned.size(); ++k)
+            {
+                own[k].valid = true;
+                own[k].accesses1 = length;
+                own[k].accesses2 = length;
+                results[owned[k]] = own[k];
+            } });
+    }
+
+    return results;
+}
+
+// Hit rate as it appears in the CSV tables: four significant digits
+inline std::string formatRate(double rate)
+{
+    std::ostringstream out;
+    out << std::setprecision(4) << rate;
+    return out.str();
+}
+
+// Writes one table of the sweep: a row per cache size and a pair of
+// first/second loop columns per value of the varied parameter, with the
+// other parameter held fixed. Matches the layout of the hand-made
+// *_by_asociativity.csv and *_by_blocksize.csv files.
+inline void writeSweepTable(const std::string &fileName, const std::vector<SweepConfig> &configs, const std::vector<SweepResult> &results,
+                            const std::vector<int> &sizes, const std::vector<int> &columns, bool byAssociativity, int fixed)
+{
+    std::ostringstream out;
+    out << "size (bytes),";
+    for (int column : columns)
+    {
+        std::string label = byAssociativity ? std::to_string(column) + "-way" : std::to_string(column) + " byte";
+        out << label << " 1st loop," << label << " 2nd loop,";
+    }
+    out << "\n";
+
+    for (int size : sizes)
+    {
+        out << size << ",";
+        for (int column : columns)
+        {
+            int associativity = byAssociativity ? column : fixed;
+            int block_size = byAssociativity ? fixed : column;
+            auto it = std::find_if(configs.begin(), configs.end(), [&](const SweepConfig &c)
+                                   { return c.size == size && c.associativity == associativity && c.block_size == block_size; });
+            const SweepResult *result = it == configs.end() ? nullptr : &results[it - configs.begin()];
+            if (result != nullptr && result->valid)
+                out << formatRate(result->hitRate1()) << "," << formatRate(result->hitRate2()) << ",";
+            else
+                out << ",,";
+        }
+        out << "\n";
+    }
+
+    std::ofstream file(fileName);
+    if (!file.is_open())
+        throw TraceError("Unable to create file " + fileName);
+    file << out.str();
+}
+
+// Writes every configuration of the sweep, one per line
+inline void writeSweepList(const std::string &fileName, const std::vector<SweepConfig> &configs, const std::vector<SweepResult> &results)
+{
+    std::ostringstream out;
+    out << "size (bytes),associativity,block size,1st loop hits,1st loop accesses,1st loop hit rate,2nd loop hits,2nd loop accesses,2nd loop hit rate\n";
+    for (std::size_t i = 0; i < configs.size(); ++i)
+    {
+        if (!results[i].valid)
+            continue;
+        const SweepResult &r = results[i];
+        out << configs[i].size << "," << configs[i].associativity << "," << configs[i].block_size << ","
+            << r.hits1 << "," << r.accesses1 << "," << formatRate(r.hitRate1()) << ","
+            << r.hits2 << "," << r.accesses2 << "," << formatRate(r.hitRate2()) << "\n";
+    }
+
+    std::ofstream file(fileName);
+    if (!file.is_open())
+        throw TraceError("Unable to create file " + fileName);
+    file << out.str();
+}
+
+#endif
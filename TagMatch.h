@@ -0,0 +1,189 @@
+#ifndef TAG_MATCH_H
+#define TAG_MATCH_H
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TAG_MATCH_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TAG_MATCH_AVX2 1
+#endif
+
+// Forces the small per-access helpers inline; the compiler's own limits
+// stop inlining them once a build holds every kernel instantiation
+#if defined(__GNUC__)
+#define FORCE_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline
+#endif
+
+// Tag lookup across the ways of one set. Finds the way holding a tag and
+// the first invalid way in one scan; the vector versions compare four or
+// eight ways per instruction and turn the results into bit masks.
+//
+// Tags are 64 bits wide but a set stores them as two arrays of 32-bit
+// halves: the low halves of all its ways, then the high halves. Lookups
+// compare the low halves, which tell tags apart nearly always, and check
+// the high half of a candidate way only, so the vector compares stay as
+// wide as with 32-bit tags.
+
+// Tag of a cached block: the block number without its set index bits
+using Tag = std::uint64_t;
+
+inline std::uint32_t lowHalf(Tag tag) { return static_cast<std::uint32_t>(tag); }
+inline std::uint32_t highHalf(Tag tag) { return static_cast<std::uint32_t>(tag >> 32); }
+
+// Writes `tag` into one way of a set of `ways` ways
+FORCE_INLINE void storeTag(std::uint32_t *set_tags, int ways, int way, Tag tag)
+{
+    set_tags[way] = lowHalf(tag);
+    set_tags[ways + way] = highHalf(tag);
+}
+
+// Reads the tag in one way of a set of `ways` ways
+inline Tag loadTag(const std::uint32_t *set_tags, int ways, int way)
+{
+    return static_cast<Tag>(set_tags[way]) | static_cast<Tag>(set_tags[ways + way]) << 32;
+}
+
+// Result of a lookup: -1 where there is no such way. The invalid way is
+// only looked for up to the hit, which is all a miss needs.
+struct WayMatch
+{
+    int hit;
+    int invalid;
+};
+
+FORCE_INLINE int lowestBit(std::uint32_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while (((mask >> bit) & 1) == 0)
+        ++bit;
+    return bit;
+#endif
+}
+
+FORCE_INLINE WayMatch matchWaysScalar(const std::uint32_t *set_tags, int ways, Tag tag, Tag invalid_tag)
+{
+    const std::uint32_t *high = set_tags + ways;
+    WayMatch match{-1, -1};
+    for (int i = 0; i < ways; ++i)
+    {
+        Tag stored = set_tags[i] | static_cast<Tag>(high[i]) << 32;
+        if (stored == tag)
+        {
+            match.hit = i;
+            return match;
+        }
+        if (stored == invalid_tag && match.invalid < 0)
+            match.invalid = i;
+    }
+    return match;
+}
+
+// First way among the candidates, whose low halves matched, whose high
+// half is `wanted` as well; -1 if there is none
+FORCE_INLINE int confirmWay(std::uint32_t candidates, const std::uint32_t *high, std::uint32_t wanted)
+{
+    for (; candidates != 0; candidates &= candidates - 1)
+    {
+        int way = lowestBit(candidates);
+        if (high[way] == wanted)
+            return way;
+    }
+    return -1;
+}
+
+// Applies the low-half matches of the group of ways starting at `base`;
+// true once the tag has been found
+FORCE_INLINE bool resolveGroup(WayMatch &match, const std::uint32_t *high, int base, std::uint32_t hits, std::uint32_t invalids, Tag tag, Tag invalid_tag)
+{
+    if (hits != 0)
+    {
+        int way = confirmWay(hits, high + base, highHalf(tag));
+        if (way >= 0)
+        {
+            match.hit = base + way;
+            return true;
+        }
+    }
+    if (invalids != 0 && match.invalid < 0)
+    {
+        int way = confirmWay(invalids, high + base, highHalf(invalid_tag));
+        if (way >= 0)
+            match.invalid = base + way;
+    }
+    return false;
+}
+
+#ifdef TAG_MATCH_SSE2
+// Four ways at a time; ways must be a multiple of four
+FORCE_INLINE WayMatch matchWaysSse2(const std::uint32_t *set_tags, int ways, Tag tag, Tag invalid_tag)
+{
+    WayMatch match{-1, -1};
+    const __m128i wanted = _mm_set1_epi32(static_cast<int>(lowHalf(tag)));
+    const __m128i empty = _mm_set1_epi32(static_cast<int>(lowHalf(invalid_tag)));
+    for (int i = 0; i < ways; i += 4)
+    {
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set_tags + i));
+        std::uint32_t hits = static_cast<std::uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, wanted))));
+        std::uint32_t invalids = static_cast<std::uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, empty))));
+        if (resolveGroup(match, set_tags + ways, i, hits, invalids, tag, invalid_tag))
+            return match;
+    }
+    return match;
+}
+#endif
+
+#ifdef TAG_MATCH_AVX2
+// Eight ways at a time; ways must be a multiple of eight. Only call it
+// from code built for AVX2 after hasAvx2() said yes.
+__attribute__((target("avx2"))) FORCE_INLINE WayMatch matchWaysAvx2(const std::uint32_t *set_tags, int ways, Tag tag, Tag invalid_tag)
+{
+    WayMatch match{-1, -1};
+    const __m256i wanted = _mm256_set1_epi32(static_cast<int>(lowHalf(tag)));
+    const __m256i empty = _mm256_set1_epi32(static_cast<int>(lowHalf(invalid_tag)));
+    for (int i = 0; i < ways; i += 8)
+    {
+        __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(set_tags + i));
+        std::uint32_t hits = static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(group, wanted))));
+        std::uint32_t invalids = static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(group, empty))));
+        if (resolveGroup(match, set_tags + ways, i, hits, invalids, tag, invalid_tag))
+            return match;
+    }
+    return match;
+}
+#endif
+
+// Whether the running CPU has AVX2, checked once
+inline bool hasAvx2()
+{
+#ifdef TAG_MATCH_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+// Lookup for any associativity with the baseline instruction set: SSE2
+// for whole groups of four ways where the target has it, else scalar
+inline WayMatch matchWays(const std::uint32_t *set_tags, int ways, Tag tag, Tag invalid_tag)
+{
+#ifdef TAG_MATCH_SSE2
+    if ((ways & 3) == 0)
+        return matchWaysSse2(set_tags, ways, tag, invalid_tag);
+#endif
+    return matchWaysScalar(set_tags, ways, tag, invalid_tag);
+}
+
+#endif
@@ -0,0 +1,885 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Memory address as read from a trace
+using Address = std::uint64_t;
+
+// Kind of memory operation recorded in a trace
+enum TraceOp : std::uint8_t
+{
+    kOpRead = 0,
+    kOpWrite = 1,
+    kOpFetch = 2
+};
+
+// Raised when a trace cannot be opened or contains a bad line
+class TraceError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// A whole trace parsed once and kept in memory, so every simulation run
+// replays it without touching the file again
+struct Trace
+{
+    std::vector<Address> addresses;
+    Address max_address = 0;
+
+    // Optional per-access fields, empty when the trace does not carry them
+    std::vector<std::uint8_t> ops; // TraceOp values
+    std::vector<std::uint16_t> sizes;
+    std::vector<std::uint32_t> threads;
+
+    std::size_t size() const { return addresses.size(); }
+    const Address *data() const { return addresses.data(); }
+};
+
+// File name that stands for standard input
+constexpr const char *kStdinName = "-";
+
+// Bytes read from standard input or a FIFO at a time
+constexpr std::size_t kStreamReadBytes = std::size_t(1) << 20;
+
+// True for standard input and anything else that is not a regular file,
+// such as a pipe or FIFO, which can be neither mapped nor read twice
+inline bool isStreamInput(const std::string &fileName)
+{
+    if (fileName == kStdinName)
+        return true;
+#ifdef _WIN32
+    return false;
+#else
+    struct stat info;
+    return ::stat(fileName.c_str(), &info) == 0 && !S_ISREG(info.st_mode);
+#endif
+}
+
+#ifndef _WIN32
+// Reads up to `count` bytes, whatever has arrived once at least one has;
+// 0 at the end of the input
+inline std::size_t readSome(int fd, char *out, std::size_t count, const std::string &fileName)
+{
+    for (;;)
+    {
+        ssize_t n = ::read(fd, out, count);
+        if (n >= 0)
+            return static_cast<std::size_t>(n);
+        if (errno != EINTR)
+            throw TraceError("Unable to read file " + fileName);
+    }
+}
+#endif
+
+// Read-only view of a whole file, memory-mapped where the platform allows.
+// Standard input, pipes and FIFOs are read into memory instead.
+class MappedFile
+{
+private:
+    const char *bytes = nullptr;
+    std::size_t length = 0;
+    std::vector<char> buffer;
+    bool mapped = false;
+
+public:
+    explicit MappedFile(const std::string &fileName)
+    {
+#ifdef _WIN32
+        if (fileName == kStdinName)
+        {
+            buffer.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+            bytes = buffer.data();
+            length = buffer.size();
+            return;
+        }
+        std::ifstream inputFile(fileName, std::ios::binary);
+        if (!inputFile.is_open())
+            throw TraceError("Unable to open file " + fileName);
+        buffer.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+#else
+        const bool stdinput = fileName == kStdinName;
+        int fd = stdinput ? STDIN_FILENO : ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw TraceError("Unable to open file " + fileName);
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            if (!stdinput)
+                ::close(fd);
+            throw TraceError("Unable to read file " + fileName);
+        }
+
+        if (!S_ISREG(info.st_mode))
+        {
+            readStream(fd, fileName);
+            if (!stdinput)
+                ::close(fd);
+            return;
+        }
+
+        length = static_cast<std::size_t>(info.st_size);
+        if (length > 0)
+        {
+            void *mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                if (!stdinput)
+                    ::close(fd);
+                throw TraceError("Unable to map file " + fileName);
+            }
+            ::madvise(mapping, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char *>(mapping);
+            mapped = true;
+        }
+        if (!stdinput)
+            ::close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (mapped)
+            ::munmap(const_cast<char *>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+#ifndef _WIN32
+    void readStream(int fd, const std::string &fileName)
+    {
+        for (;;)
+        {
+            std::size_t used = buffer.size();
+            buffer.resize(used + kStreamReadBytes);
+            std::size_t n = readSome(fd, buffer.data() + used, kStreamReadBytes, fileName);
+            buffer.resize(used + n);
+            if (n == 0)
+                break;
+        }
+        bytes = buffer.data();
+        length = buffer.size();
+    }
+#endif
+};
+
+// Value of each byte as a hexadecimal digit, or 0xFF for anything else
+inline const std::uint8_t *hexDigitTable()
+{
+    static const auto table = []
+    {
+        std::array<std::uint8_t, 256> t{};
+        t.fill(0xFF);
+        for (int c = '0'; c <= '9'; ++c)
+            t[c] = static_cast<std::uint8_t>(c - '0');
+        for (int c = 'a'; c <= 'f'; ++c)
+            t[c] = static_cast<std::uint8_t>(c - 'a' + 10);
+        for (int c = 'A'; c <= 'F'; ++c)
+            t[c] = static_cast<std::uint8_t>(c - 'A' + 10);
+        return t;
+    }();
+    return table.data();
+}
+
+// Parses newline-separated hexadecimal addresses from a text buffer.
+// Each line may carry surrounding blanks, a CR before the newline and an
+// optional 0x prefix; blank lines are skipped. Anything else is reported
+// with its line number, counting `linesBefore` lines ahead of the text.
+// Returns the number of lines parsed.
+inline std::size_t parseHexTrace(const char *text, std::size_t length, Trace &trace, std::size_t linesBefore = 0)
+{
+    const std::uint8_t *digit = hexDigitTable();
+    const char *p = text;
+    const char *end = text + length;
+    const int maxDigits = static_cast<int>(sizeof(Address) * 2);
+
+    // Size the buffer exactly; counting newlines is far cheaper than parsing
+    trace.addresses.reserve(trace.addresses.size() + std::count(p, end, '\n') + 1);
+
+    Address maxAddress = trace.max_address;
+    std::size_t lineNumber = linesBefore;
+
+    while (p < end)
+    {
+        ++lineNumber;
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (eol == nullptr)
+            eol = end;
+
+        const char *q = p;
+        const char *last = eol;
+        while (q < last && (*q == ' ' || *q == '\t'))
+            ++q;
+        while (last > q && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+            --last;
+
+        if (q < last)
+        {
+            if (last - q > 2 && q[0] == '0' && (q[1] == 'x' || q[1] == 'X'))
+                q += 2;
+            while (q < last - 1 && *q == '0')
+                ++q;
+
+            const char *first = q;
+            Address value = 0;
+            std::uint8_t bad = 0;
+            for (; q < last; ++q)
+            {
+                std::uint8_t d = digit[static_cast<unsigned char>(*q)];
+                bad |= d;
+                value = (value << 4) | (d & 0x0F);
+            }
+
+            // A non-digit has bit 7 set in the table, so it sticks in 'bad'
+            if ((bad & 0x80) != 0)
+                throw TraceError("Invalid address on line " + std::to_string(lineNumber) + ": '" + std::string(p, eol - p) + "'");
+            if (last - first > maxDigits)
+                throw TraceError("Address out of range on line " + std::to_string(lineNumber) + ": '" + std::string(p, eol - p) + "'");
+
+            trace.addresses.push_back(value);
+            maxAddress = std::max(maxAddress, value);
+        }
+
+        p = eol + 1;
+    }
+
+    trace.max_address = maxAddress;
+    return lineNumber - linesBefore;
+}
+
+// Binary trace format, version 1. All integers are little-endian.
+//
+//   offset  size  field
+//        0     4  magic "CTRC"
+//        4     2  version
+//        6     1  address width in bytes (4 or 8)
+//        7     1  fields present: kFieldOp | kFieldSize | kFieldThread
+//        8     8  record count
+//       16     1  encoding (kEncodingFixed or kEncodingDeltaVarint)
+//       17    15  reserved, zero
+//       32        addresses, count * width bytes
+//                 then, if present, ops (u8), sizes (u16), threads (u32)
+//
+// Each field is stored as its own array so the addresses can be loaded
+// without touching the optional fields.
+namespace binary_trace
+{
+    constexpr char kMagic[4] = {'C', 'T', 'R', 'C'};
+    constexpr std::uint16_t kVersion = 1;
+    constexpr std::size_t kHeaderBytes = 32;
+
+    constexpr std::uint8_t kFieldOp = 1;
+    constexpr std::uint8_t kFieldSize = 2;
+    constexpr std::uint8_t kFieldThread = 4;
+
+    constexpr std::uint8_t kEncodingFixed = 0;
+
+    struct Header
+    {
+        std::uint16_t version = kVersion;
+        std::uint8_t address_bytes = 8;
+        std::uint8_t fields = 0;
+        std::uint64_t count = 0;
+        std::uint8_t encoding = kEncodingFixed;
+    };
+
+    inline std::uint64_t loadLE(const char *p, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+        return value;
+    }
+
+    inline void storeLE(char *p, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            p[i] = static_cast<char>(value >> (8 * i));
+    }
+
+    inline bool isBinary(const char *data, std::size_t length)
+    {
+        return length >= sizeof(kMagic) && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+    }
+
+    inline Header readHeader(const char *data, std::size_t length)
+    {
+        if (length < kHeaderBytes || !isBinary(data, length))
+            throw TraceError("Truncated binary trace header");
+
+        Header header;
+        header.version = static_cast<std::uint16_t>(loadLE(data + 4, 2));
+        header.address_bytes = static_cast<std::uint8_t>(data[6]);
+        header.fields = static_cast<std::uint8_t>(data[7]);
+        header.count = loadLE(data + 8, 8);
+        header.encoding = static_cast<std::uint8_t>(data[16]);
+
+        if (header.version != kVersion)
+            throw TraceError("Unsupported binary trace version " + std::to_string(header.version));
+        if (header.address_bytes != 4 && header.address_bytes != 8)
+            throw TraceError("Unsupported binary trace address width " + std::to_string(header.address_bytes));
+        return header;
+    }
+
+    inline void writeHeader(char *out, const Header &header)
+    {
+        std::memset(out, 0, kHeaderBytes);
+        std::memcpy(out, kMagic, sizeof(kMagic));
+        storeLE(out + 4, header.version, 2);
+        out[6] = static_cast<char>(header.address_bytes);
+        out[7] = static_cast<char>(header.fields);
+        storeLE(out + 8, header.count, 8);
+        out[16] = static_cast<char>(header.encoding);
+    }
+
+    // Bytes taken by the optional fields of one record
+    inline std::size_t fieldBytes(std::uint8_t fields)
+    {
+        return ((fields & kFieldOp) ? 1 : 0) + ((fields & kFieldSize) ? 2 : 0) + ((fields & kFieldThread) ? 4 : 0);
+    }
+
+    // Fields a trace carries, as header flags
+    inline std::uint8_t fieldsOf(const Trace &trace)
+    {
+        return static_cast<std::uint8_t>((trace.ops.empty() ? 0 : kFieldOp) | (trace.sizes.empty() ? 0 : kFieldSize) | (trace.threads.empty() ? 0 : kFieldThread));
+    }
+}
+
+// Decodes a binary trace. The optional fields are only read when
+// withFields is set; the simulator needs nothing but the addresses.
+inline void parseBinaryTrace(const char *data, std::size_t length, Trace &trace, bool withFields = false)
+{
+    using namespace binary_trace;
+    Header header = readHeader(data, length);
+    if (header.encoding != kEncodingFixed)
+        throw TraceError("Unsupported binary trace encoding " + std::to_string(header.encoding));
+
+    const std::uint64_t count = header.count;
+    const int width = header.address_bytes;
+    const std::uint64_t recordBytes = width + fieldBytes(header.fields);
+    if (count > (length - kHeaderBytes) / recordBytes || kHeaderBytes + count * recordBytes != length)
+        throw TraceError("Binary trace size does not match its record count");
+
+    const char *p = data + kHeaderBytes;
+    if (width > static_cast<int>(sizeof(Address)))
+    {
+        // Only possible where Address is narrower than 64 bits
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            if (loadLE(p + i * width, width) > std::numeric_limits<Address>::max())
+                throw TraceError("Address out of range in record " + std::to_string(i));
+        }
+    }
+
+    std::size_t base = trace.addresses.size();
+    trace.addresses.resize(base + count);
+    Address *out = trace.addresses.data() + base;
+    Address maxAddress = trace.max_address;
+    if (width == 8)
+    {
+        for (std::uint64_t i = 0; i < count; ++i, p += 8)
+        {
+            out[i] = static_cast<Address>(loadLE(p, 8));
+            maxAddress = std::max(maxAddress, out[i]);
+        }
+    }
+    else
+    {
+        for (std::uint64_t i = 0; i < count; ++i, p += 4)
+        {
+            out[i] = static_cast<Address>(loadLE(p, 4));
+            maxAddress = std::max(maxAddress, out[i]);
+        }
+    }
+    trace.max_address = maxAddress;
+
+    if (!withFields)
+        return;
+
+    if (header.fields & kFieldOp)
+    {
+        const std::uint8_t *ops = reinterpret_cast<const std::uint8_t *>(p);
+        trace.ops.insert(trace.ops.end(), ops, ops + count);
+        p += count;
+    }
+    if (header.fields & kFieldSize)
+    {
+        for (std::uint64_t i = 0; i < count; ++i, p += 2)
+            trace.sizes.push_back(static_cast<std::uint16_t>(loadLE(p, 2)));
+    }
+    if (header.fields & kFieldThread)
+    {
+        for (std::uint64_t i = 0; i < count; ++i, p += 4)
+            trace.threads.push_back(static_cast<std::uint32_t>(loadLE(p, 4)));
+    }
+}
+
+// Writes a trace in the binary format. Optional fields are stored when
+// the trace carries them. addressBytes must be 4 or 8.
+inline void writeBinaryTrace(const std::string &fileName, const Trace &trace, int addressBytes = 8)
+{
+    using namespace binary_trace;
+    if (addressBytes != 4 && addressBytes != 8)
+        throw TraceError("Address width must be 4 or 8 bytes");
+    if (addressBytes == 4 && trace.max_address > 0xFFFFFFFFul)
+        throw TraceError("Trace addresses do not fit in 4 bytes");
+
+    const std::size_t count = trace.size();
+    Header header;
+    header.address_bytes = static_cast<std::uint8_t>(addressBytes);
+    header.fields = fieldsOf(trace);
+    header.count = count;
+
+    char headerBytes[kHeaderBytes];
+    writeHeader(headerBytes, header);
+    std::vector<char> out(kHeaderBytes + count * (addressBytes + fieldBytes(header.fields)));
+    std::memcpy(out.data(), headerBytes, kHeaderBytes);
+
+    char *p = out.data() + kHeaderBytes;
+    for (std::size_t i = 0; i < count; ++i, p += addressBytes)
+        storeLE(p, trace.addresses[i], addressBytes);
+    if (header.fields & kFieldOp)
+    {
+        std::memcpy(p, trace.ops.data(), count);
+        p += count;
+    }
+    if (header.fields & kFieldSize)
+    {
+        for (std::size_t i = 0; i < count; ++i, p += 2)
+            storeLE(p, trace.sizes[i], 2);
+    }
+    if (header.fields & kFieldThread)
+    {
+        for (std::size_t i = 0; i < count; ++i, p += 4)
+            storeLE(p, trace.threads[i], 4);
+    }
+
+    std::ofstream outputFile(fileName, std::ios::binary);
+    if (!outputFile.is_open())
+        throw TraceError("Unable to create file " + fileName);
+    outputFile.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!outputFile)
+        throw TraceError("Unable to write file " + fileName);
+}
+
+// Delta/varint encoding (kEncodingDeltaVarint) of the binary format.
+// After the usual header the records are stored in chunks of at most
+// kPackedChunkRecords:
+//
+//   u32 record count, u32 payload bytes, u8 codec (kCodecNone), 3 zero bytes
+//   payload: one stream per field, addresses first, then the optional
+//            ops, sizes and threads in header order
+//
+// Each stream holds the zig-zag LEB128 varint of the difference between a
+// value and the one before it, starting from 0 in every chunk, so chunks
+// decode independently. Strided traces shrink to a byte or two per access.
+namespace binary_trace
+{
+    constexpr std::uint8_t kEncodingDeltaVarint = 1;
+    constexpr std::uint8_t kCodecNone = 0;
+    constexpr std::size_t kChunkHeaderBytes = 12;
+    constexpr std::size_t kPackedChunkRecords = 1 << 16;
+
+    inline void putVarint(std::vector<char> &out, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // Appends one delta/varint stream of count values read through get(i)
+    template <typename Get>
+    void putDeltaStream(std::vector<char> &out, std::size_t count, Get get)
+    {
+        std::uint64_t prev = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::uint64_t value = get(i);
+            std::int64_t delta = static_cast<std::int64_t>(value - prev);
+            putVarint(out, (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+            prev = value;
+        }
+    }
+
+    // Decodes one delta/varint stream into out[0, count), calling put(i, v)
+    template <typename Put>
+    const char *getDeltaStream(const char *p, const char *end, std::size_t count, Put put)
+    {
+        std::uint64_t prev = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::uint64_t zz = 0;
+            int shift = 0;
+            for (;;)
+            {
+                if (p == end || shift > 63)
+                    throw TraceError("Corrupt packed trace chunk");
+                std::uint8_t byte = static_cast<std::uint8_t>(*p++);
+                zz |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    break;
+                shift += 7;
+            }
+            prev += (zz >> 1) ^ (~(zz & 1) + 1);
+            put(i, prev);
+        }
+        return p;
+    }
+}
+
+// Streams the chunks of a packed trace. The decoder owns no copy of the
+// input; it decodes one chunk at a time into a caller-provided buffer.
+class PackedTraceDecoder
+{
+private:
+    binary_trace::Header header;
+    const char *p;
+    const char *end;
+
+public:
+    PackedTraceDecoder(const char *data, std::size_t length) : header(binary_trace::readHeader(data, length)), p(data + binary_trace::kHeaderBytes), end(data + length)
+    {
+        if (header.encoding != binary_trace::kEncodingDeltaVarint)
+            throw TraceError("Not a packed trace");
+    }
+
+    const binary_trace::Header &info() const { return header; }
+
+    // Decodes the next chunk's addresses into out; false once all chunks
+    // are consumed. Optional fields are appended to fields when given.
+    bool next(std::vector<Address> &out, Trace *fields = nullptr)
+    {
+        using namespace binary_trace;
+        std::size_t count;
+        std::size_t bytes;
+        if (!chunkHeader(count, bytes))
+            return false;
+
+        const char *chunkEnd = p + bytes;
+        out.resize(count);
+        Address *addresses = out.data();
+        const char *q = getDeltaStream(p, chunkEnd, count, [&](std::size_t i, std::uint64_t v)
+                                       {
+                                           if (v > std::numeric_limits<Address>::max())
+                                               throw TraceError("Address out of range in packed trace");
+                                           addresses[i] = static_cast<Address>(v); });
+
+        if (fields != nullptr)
+        {
+            if (header.fields & kFieldOp)
+                q = getDeltaStream(q, chunkEnd, count, [&](std::size_t, std::uint64_t v)
+                                   { fields->ops.push_back(static_cast<std::uint8_t>(v)); });
+            if (header.fields & kFieldSize)
+                q = getDeltaStream(q, chunkEnd, count, [&](std::size_t, std::uint64_t v)
+                                   { fields->sizes.push_back(static_cast<std::uint16_t>(v)); });
+            if (header.fields & kFieldThread)
+                q = getDeltaStream(q, chunkEnd, count, [&](std::size_t, std::uint64_t v)
+                                   { fields->threads.push_back(static_cast<std::uint32_t>(v)); });
+        }
+
+        p = chunkEnd;
+        return true;
+    }
+
+    // Moves past the next chunk without decoding it; false once all chunks
+    // are consumed
+    bool skip()
+    {
+        std::size_t count;
+        std::size_t bytes;
+        if (!chunkHeader(count, bytes))
+            return false;
+        p += bytes;
+        return true;
+    }
+
+private:
+    // Reads and checks the header of the next chunk, leaving p at its
+    // payload; false at the end of the trace
+    bool chunkHeader(std::size_t &count, std::size_t &bytes)
+    {
+        using namespace binary_trace;
+        if (p == end)
+            return false;
+        if (static_cast<std::size_t>(end - p) < kChunkHeaderBytes)
+            throw TraceError("Truncated packed trace chunk");
+
+        count = static_cast<std::size_t>(loadLE(p, 4));
+        bytes = static_cast<std::size_t>(loadLE(p + 4, 4));
+        std::uint8_t codec = static_cast<std::uint8_t>(p[8]);
+        p += kChunkHeaderBytes;
+        if (codec != kCodecNone)
+            throw TraceError("Unsupported packed trace codec " + std::to_string(codec));
+        if (count > kPackedChunkRecords || bytes > static_cast<std::size_t>(end - p))
+            throw TraceError("Corrupt packed trace chunk");
+        return true;
+    }
+};
+
+// Appends the packed chunks for records [first, first + count) of trace
+inline void encodePackedChunks(const Trace &trace, std::size_t first, std::size_t count, std::vector<char> &out)
+{
+    using namespace binary_trace;
+    std::uint8_t fields = fieldsOf(trace);
+    for (std::size_t begin = first; begin < first + count; begin += kPackedChunkRecords)
+    {
+        std::size_t n = std::min(kPackedChunkRecords, first + count - begin);
+        std::size_t chunkHeader = out.size();
+        out.resize(out.size() + kChunkHeaderBytes, 0);
+
+        putDeltaStream(out, n, [&](std::size_t i)
+                       { return static_cast<std::uint64_t>(trace.addresses[begin + i]); });
+        if (fields & kFieldOp)
+            putDeltaStream(out, n, [&](std::size_t i)
+                           { return static_cast<std::uint64_t>(trace.ops[begin + i]); });
+        if (fields & kFieldSize)
+            putDeltaStream(out, n, [&](std::size_t i)
+                           { return static_cast<std::uint64_t>(trace.sizes[begin + i]); });
+        if (fields & kFieldThread)
+            putDeltaStream(out, n, [&](std::size_t i)
+                           { return static_cast<std::uint64_t>(trace.threads[begin + i]); });
+
+        char *h = out.data() + chunkHeader;
+        storeLE(h, n, 4);
+        storeLE(h + 4, out.size() - chunkHeader - kChunkHeaderBytes, 4);
+        h[8] = static_cast<char>(kCodecNone);
+    }
+}
+
+// Writes a trace with the delta/varint encoding
+inline void writePackedTrace(const std::string &fileName, const Trace &trace)
+{
+    using namespace binary_trace;
+    Header header;
+    header.fields = fieldsOf(trace);
+    header.count = trace.size();
+    header.encoding = kEncodingDeltaVarint;
+
+    std::vector<char> out(kHeaderBytes);
+    writeHeader(out.data(), header);
+    encodePackedChunks(trace, 0, trace.size(), out);
+
+    std::ofstream outputFile(fileName, std::ios::binary);
+    if (!outputFile.is_open())
+        throw TraceError("Unable to create file " + fileName);
+    outputFile.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!outputFile)
+        throw TraceError("Unable to write file " + fileName);
+}
+
+// Letter used for each TraceOp in text traces
+inline char opLetter(std::uint8_t op)
+{
+    static const char letters[] = {'R', 'W', 'F'};
+    return op < sizeof(letters) ? letters[op] : '?';
+}
+
+// Writes a trace as text, one hexadecimal address per line. Optional
+// fields follow the address as columns: op (R, W or F), size, thread.
+inline void writeTextTrace(const std::string &fileName, const Trace &trace)
+{
+    std::ofstream outputFile(fileName, std::ios::binary);
+    if (!outputFile.is_open())
+        throw TraceError("Unable to create file " + fileName);
+
+    std::string out;
+    char line[64];
+    for (std::size_t i = 0; i < trace.size(); ++i)
+    {
+        int n = std::snprintf(line, sizeof(line), "%llx", static_cast<unsigned long long>(trace.addresses[i]));
+        out.append(line, n);
+        if (!trace.ops.empty())
+        {
+            out += ' ';
+            out += opLetter(trace.ops[i]);
+        }
+        if (!trace.sizes.empty())
+            out += ' ' + std::to_string(trace.sizes[i]);
+        if (!trace.threads.empty())
+            out += ' ' + std::to_string(trace.threads[i]);
+        out += '\n';
+
+        // Write in large blocks rather than per line
+        if (out.size() >= (1u << 20))
+        {
+            outputFile.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+    }
+    outputFile.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!outputFile)
+        throw TraceError("Unable to write file " + fileName);
+}
+
+// Parses a whole trace already in memory. Binary traces are recognised by
+// their magic; anything else is text with one hexadecimal address per line.
+inline Trace parseTrace(const char *data, std::size_t length, bool withFields = false)
+{
+    Trace trace;
+    if (!binary_trace::isBinary(data, length))
+    {
+        parseHexTrace(data, length, trace);
+        return trace;
+    }
+
+    if (binary_trace::readHeader(data, length).encoding != binary_trace::kEncodingDeltaVarint)
+    {
+        parseBinaryTrace(data, length, trace, withFields);
+        return trace;
+    }
+
+    PackedTraceDecoder decoder(data, length);
+    std::vector<Address> chunk;
+    while (decoder.next(chunk, withFields ? &trace : nullptr))
+    {
+        trace.addresses.insert(trace.addresses.end(), chunk.begin(), chunk.end());
+        for (Address a : chunk)
+            trace.max_address = std::max(trace.max_address, a);
+    }
+    return trace;
+}
+
+// Reads a whole trace in a single pass
+inline Trace loadTrace(const std::string &fileName, bool withFields = false)
+{
+    MappedFile file(fileName);
+    return parseTrace(file.data(), file.size(), withFields);
+}
+
+// Reads a text trace from standard input or a FIFO as it arrives, a block
+// of whole lines at a time, so a tracer can feed the simulator live
+class TraceStream
+{
+private:
+    std::string name;
+#ifdef _WIN32
+    std::FILE *file = nullptr;
+#else
+    int fd = -1;
+#endif
+    std::vector<char> pending; // bytes read but not yet parsed
+    std::size_t lines = 0;
+    bool ended = false;
+
+public:
+    explicit TraceStream(const std::string &fileName) : name(fileName)
+    {
+#ifdef _WIN32
+        file = fileName == kStdinName ? stdin : std::fopen(fileName.c_str(), "rb");
+        if (file == nullptr)
+            throw TraceError("Unable to open file " + fileName);
+#else
+        fd = fileName == kStdinName ? STDIN_FILENO : ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw TraceError("Unable to open file " + fileName);
+#endif
+        // Enough of the input to tell a binary trace by its magic
+        while (!ended && pending.size() < sizeof(binary_trace::kMagic))
+            fill();
+    }
+
+    ~TraceStream()
+    {
+#ifdef _WIN32
+        if (file != stdin)
+            std::fclose(file);
+#else
+        if (fd != STDIN_FILENO)
+            ::close(fd);
+#endif
+    }
+
+    TraceStream(const TraceStream &) = delete;
+    TraceStream &operator=(const TraceStream &) = delete;
+
+    bool binary() const { return binary_trace::isBinary(pending.data(), pending.size()); }
+
+    // Reads the rest of the input and returns all of it, for binary traces
+    std::vector<char> readAll()
+    {
+        while (!ended)
+            fill();
+        return std::move(pending);
+    }
+
+    // Replaces `out` with the addresses of the next block of whole lines;
+    // false once the input is exhausted
+    bool next(std::vector<Address> &out)
+    {
+        out.clear();
+        Trace block;
+        block.addresses.swap(out);
+        while (block.addresses.empty())
+        {
+            if (ended && pending.empty())
+                break;
+            if (!ended)
+                fill();
+
+            // Whole lines only, unless the input ended without a newline
+            std::size_t usable = pending.size();
+            if (!ended)
+            {
+                auto last = std::find(pending.rbegin(), pending.rend(), '\n');
+                usable = static_cast<std::size_t>(pending.rend() - last);
+            }
+            lines += parseHexTrace(pending.data(), usable, block, lines);
+            pending.erase(pending.begin(), pending.begin() + usable);
+        }
+        block.addresses.swap(out);
+        return !out.empty();
+    }
+
+private:
+    void fill()
+    {
+        std::size_t used = pending.size();
+        pending.resize(used + kStreamReadBytes);
+#ifdef _WIN32
+        std::size_t n = std::fread(pending.data() + used, 1, kStreamReadBytes, file);
+        if (n == 0 && std::ferror(file))
+            throw TraceError("Unable to read file " + name);
+#else
+        std::size_t n = readSome(fd, pending.data() + used, kStreamReadBytes, name);
+#endif
+        pending.resize(used + n);
+        ended = n == 0;
+    }
+};
+
+#endif
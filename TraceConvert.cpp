@@ -0,0 +1,188 @@
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Trace.h"
+
+// trace-convert: moves address traces between the text, binary and packed
+// binary formats
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <input_file> <output_file> [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --to <format>        text, binary or packed (delta/varint binary);" << std::endl;
+    std::cerr << "                       default: text for binary input, else binary" << std::endl;
+    std::cerr << "  --width <4|8>        binary address width in bytes (default 8)" << std::endl;
+    std::cerr << "  --fields <list>      extra columns in a text input, in order," << std::endl;
+    std::cerr << "                       from op,size,thread (op is R, W or F)" << std::endl;
+}
+
+// Parses a text trace whose lines are "<hex address> <columns...>"
+Trace parseTextWithFields(const char *data, std::size_t length, const std::vector<std::string> &fields)
+{
+    Trace trace;
+    std::istringstream lines(std::string(data, length));
+    std::string line;
+    std::size_t lineNumber = 0;
+
+    while (std::getline(lines, line))
+    {
+        ++lineNumber;
+        std::istringstream columns(line);
+        std::string token;
+        if (!(columns >> token))
+            continue;
+
+        auto fail = [&]()
+        {
+            return TraceError("Invalid record on line " + std::to_string(lineNumber) + ": '" + line + "'");
+        };
+
+        // Hexadecimal digits only; strtoull would also take a sign or "0x"
+        auto isHexDigit = [](char c)
+        { return std::isxdigit(static_cast<unsigned char>(c)) != 0; };
+        if (!std::all_of(token.begin(), token.end(), isHexDigit))
+            throw fail();
+
+        char *end = nullptr;
+        errno = 0;
+        unsigned long long address = std::strtoull(token.c_str(), &end, 16);
+        if (*end != '\0' || errno == ERANGE || address > std::numeric_limits<Address>::max())
+            throw fail();
+        trace.addresses.push_back(static_cast<Address>(address));
+        trace.max_address = std::max(trace.max_address, static_cast<Address>(address));
+
+        for (const std::string &field : fields)
+        {
+            if (!(columns >> token))
+                throw fail();
+            if (field == "op")
+            {
+                if (token == "R" || token == "r")
+                    trace.ops.push_back(kOpRead);
+                else if (token == "W" || token == "w")
+                    trace.ops.push_back(kOpWrite);
+                else if (token == "F" || token == "f")
+                    trace.ops.push_back(kOpFetch);
+                else
+                    throw fail();
+                continue;
+            }
+
+            // Decimal digits only; strtoull would also take a sign
+            errno = 0;
+            unsigned long long value = std::strtoull(token.c_str(), &end, 10);
+            if (token[0] < '0' || token[0] > '9' || *end != '\0')
+                throw fail();
+            const unsigned long long limit = field == "size" ? std::numeric_limits<std::uint16_t>::max() : std::numeric_limits<std::uint32_t>::max();
+            if (errno == ERANGE || value > limit)
+                throw TraceError("Value out of range on line " + std::to_string(lineNumber) + ": " + field + " " + token + " is above " + std::to_string(limit));
+            if (field == "size")
+                trace.sizes.push_back(static_cast<std::uint16_t>(value));
+            else
+                trace.threads.push_back(static_cast<std::uint32_t>(value));
+        }
+    }
+
+    return trace;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> positional;
+    std::string to;
+    int width = 8;
+    std::vector<std::string> fields;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0)
+        {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--to" && (value == "text" || value == "binary" || value == "packed"))
+            to = value;
+        else if (arg == "--width" && (value == "4" || value == "8"))
+            width = std::stoi(value);
+        else if (arg == "--fields")
+        {
+            std::istringstream list(value);
+            std::string field;
+            while (std::getline(list, field, ','))
+            {
+                if (field != "op" && field != "size" && field != "thread")
+                {
+                    std::cerr << "Error: Unknown field " << field << std::endl;
+                    return 1;
+                }
+                if (std::find(fields.begin(), fields.end(), field) != fields.end())
+                {
+                    std::cerr << "Error: Field " << field << " named twice" << std::endl;
+                    return 1;
+                }
+                fields.push_back(field);
+            }
+        }
+        else
+        {
+            std::cerr << "Error: Invalid option " << arg << " " << value << std::endl;
+            return 1;
+        }
+    }
+
+    if (positional.size() != 2)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        // Read once: standard input or a FIFO cannot be read again
+        MappedFile input(positional[0]);
+        const bool inputIsBinary = binary_trace::isBinary(input.data(), input.size());
+        if (to.empty())
+            to = inputIsBinary ? "text" : "binary";
+
+        Trace trace;
+        if (inputIsBinary || fields.empty())
+            trace = parseTrace(input.data(), input.size(), true);
+        else
+            trace = parseTextWithFields(input.data(), input.size(), fields);
+        if (trace.size() == 0 && input.size() > 0)
+            throw TraceError("No records in " + positional[0]);
+
+        if (to == "binary")
+            writeBinaryTrace(positional[1], trace, width);
+        else if (to == "packed")
+            writePackedTrace(positional[1], trace);
+        else
+            writeTextTrace(positional[1], trace);
+
+        std::cout << "Converted " << trace.size() << " records to " << to << std::endl;
+    }
+    catch (const TraceError &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef TRACE_FILTER_H
+#define TRACE_FILTER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "TagMatch.h"
+#include "Trace.h"
+
+// Filter stage applied to parsed addresses before any cache sees them.
+// An access is kept when it is past the first `skip` accesses of the
+// trace, falls in one of the include ranges (or there are none) and in
+// none of the exclude ranges, and is the sampled one of its group; the
+// first `limit` accesses kept are all a pass simulates. The range tests
+// run over a whole buffer at a time, four addresses per AVX2 compare
+// where the CPU has it.
+
+// Addresses low to high, both included
+struct AddressRange
+{
+    Address low;
+    Address high;
+};
+
+struct TraceFilter
+{
+    std::vector<AddressRange> include;
+    std::vector<AddressRange> exclude;
+    std::uint64_t skip = 0;
+    std::uint64_t limit = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t sample = 1; // keep one access in every `sample` that pass the ranges
+
+    bool active() const
+    {
+        return !include.empty() || !exclude.empty() || skip > 0 || limit != std::numeric_limits<std::uint64_t>::max() || sample > 1;
+    }
+
+    // Drops every address above `bound`, the old upper bound of a run
+    void addUpperBound(Address bound)
+    {
+        if (bound < std::numeric_limits<Address>::max())
+            exclude.push_back(AddressRange{bound + 1, std::numeric_limits<Address>::max()});
+    }
+};
+
+// Parses an address as decimal, or as hexadecimal after 0x
+inline Address parseAddress(const std::string &text)
+{
+    std::size_t used = 0;
+    bool hex = text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+    unsigned long long value = std::stoull(hex ? text.substr(2) : text, &used, hex ? 16 : 10);
+    if (used != text.size() - (hex ? 2 : 0))
+        throw std::invalid_argument("bad address '" + text + "'");
+    return static_cast<Address>(value);
+}
+
+// Parses "low-high", both included
+inline AddressRange parseAddressRange(const std::string &text)
+{
+    std::size_t dash = text.find('-');
+    if (dash == std::string::npos)
+        throw std::invalid_argument("address range '" + text + "' is not low-high");
+    AddressRange range{parseAddress(text.substr(0, dash)), parseAddress(text.substr(dash + 1))};
+    if (range.low > range.high)
+        throw std::invalid_argument("address range '" + text + "' is empty");
+    return range;
+}
+
+// Range test of one address: inside a range is (address - low) <= span,
+// one unsigned compare
+inline bool passesRanges(Address address, const std::vector<AddressRange> &include, const std::vector<AddressRange> &exclude)
+{
+    bool in = include.empty();
+    for (const AddressRange &r : include)
+        in |= address - r.low <= r.high - r.low;
+    for (const AddressRange &r : exclude)
+        in &= !(address - r.low <= r.high - r.low);
+    return in;
+}
+
+// Copies the addresses of in[0, count) that pass the ranges to out and
+// returns how many there were. out may be in.
+inline std::size_t filterRangesScalar(const Address *in, std::size_t count, const std::vector<AddressRange> &include,
+                                      const std::vector<AddressRange> &exclude, Address *out)
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Address a = in[i];
+        out[kept] = a;
+        kept += passesRanges(a, include, exclude);
+    }
+    return kept;
+}
+
+#ifdef TAG_MATCH_AVX2
+// All-ones in the lanes of `addresses` inside r. AVX2 compares signed
+// lanes only, so both sides of the unsigned compare get their sign bit
+// flipped.
+__attribute__((target("avx2"))) inline __m256i insideRangeAvx2(__m256i addresses, const AddressRange &r)
+{
+    const __m256i sign = _mm256_set1_epi64x(std::numeric_limits<std::int64_t>::min());
+    __m256i offset = _mm256_xor_si256(_mm256_sub_epi64(addresses, _mm256_set1_epi64x(static_cast<long long>(r.low))), sign);
+    __m256i span = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(r.high - r.low)), sign);
+    return _mm256_xor_si256(_mm256_cmpgt_epi64(offset, span), _mm256_set1_epi64x(-1));
+}
+
+// The same as filterRangesScalar, four addresses per compare
+__attribute__((target("avx2"))) inline std::size_t filterRangesAvx2(const Address *in, std::size_t count, const std::vector<AddressRange> &include,
+                                                                     const std::vector<AddressRange> &exclude, Address *out)
+{
+    std::size_t kept = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i addresses = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        __m256i keep = include.empty() ? _mm256_set1_epi64x(-1) : _mm256_setzero_si256();
+        for (const AddressRange &r : include)
+            keep = _mm256_or_si256(keep, insideRangeAvx2(addresses, r));
+        for (const AddressRange &r : exclude)
+            keep = _mm256_andnot_si256(insideRangeAvx2(addresses, r), keep);
+
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(keep)));
+        Address lanes[4] = {in[i], in[i + 1], in[i + 2], in[i + 3]};
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            out[kept] = lanes[lane];
+            kept += (mask >> lane) & 1;
+        }
+    }
+    return kept + filterRangesScalar(in + i, count - i, include, exclude, out + kept);
+}
+#endif
+
+inline std::size_t filterRanges(const Address *in, std::size_t count, const std::vector<AddressRange> &include, const std::vector<AddressRange> &exclude,
+                                Address *out)
+{
+    if (include.empty() && exclude.empty())
+    {
+        std::copy(in, in + count, out);
+        return count;
+    }
+#ifdef TAG_MATCH_AVX2
+    if (hasAvx2())
+        return filterRangesAvx2(in, count, include, exclude, out);
+#endif
+    return filterRangesScalar(in, count, include, exclude, out);
+}
+
+// A filter applied to one pass over a trace, a buffer at a time; skip,
+// sample and limit count from the start of the pass
+class FilterPass
+{
+private:
+    const TraceFilter &filter;
+    std::uint64_t seen = 0;    // accesses of the trace so far
+    std::uint64_t passed = 0;  // of those, accesses inside the ranges
+    std::uint64_t kept = 0;
+
+public:
+    // How far a pass has got, to resume it after buffers it skipped
+    struct Position
+    {
+        std::uint64_t seen;
+        std::uint64_t passed;
+        std::uint64_t kept;
+    };
+
+    explicit FilterPass(const TraceFilter &filter) : filter(filter) {}
+
+    Position position() const { return Position{seen, passed, kept}; }
+
+    void seek(const Position &at)
+    {
+        seen = at.seen;
+        passed = at.passed;
+        kept = at.kept;
+    }
+
+    // Whether no later access can be kept
+    bool done() const { return kept >= filter.limit; }
+
+    // Replaces out with the accesses of in[0, count) that are kept
+    void apply(const Address *in, std::size_t count, std::vector<Address> &out)
+    {
+        std::size_t skipped = static_cast<std::size_t>(std::min<std::uint64_t>(count, filter.skip - std::min(filter.skip, seen)));
+        seen += count;
+        out.resize(count - skipped);
+        std::size_t n = filterRanges(in + skipped, count - skipped, filter.include, filter.exclude, out.data());
+
+        if (filter.sample > 1)
+        {
+            // Keep the last access of every group of `sample`
+            std::size_t m = 0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                out[m] = out[i];
+                m += ++passed % filter.sample == 0;
+            }
+            n = m;
+        }
+
+        n = static_cast<std::size_t>(std::min<std::uint64_t>(n, filter.limit - std::min(filter.limit, kept)));
+        kept += n;
+        out.resize(n);
+    }
+};
+
+// Filters a whole trace in place. Optional per-access fields are dropped,
+// as they would no longer line up.
+inline void applyFilter(const TraceFilter &filter, Trace &trace)
+{
+    if (!filter.active())
+        return;
+
+    FilterPass pass(filter);
+    std::vector<Address> kept;
+    pass.apply(trace.data(), trace.size(), kept);
+    trace.addresses.swap(kept);
+    trace.max_address = trace.addresses.empty() ? 0 : *std::max_element(trace.addresses.begin(), trace.addresses.end());
+    trace.ops.clear();
+    trace.sizes.clear();
+    trace.threads.clear();
+}
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef TRACE_SOURCE_H
+#define TRACE_SOURCE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BlockRuns.h"
+#include "Trace.h"
+#include "TraceFilter.h"
+
+// A trace ready to be replayed any number of times. Text and fixed-width
+// binary traces are decoded into memory once; packed traces stay mapped
+// and are decoded chunk by chunk on every replay, so they never need the
+// full decoded size in memory.
+//
+// Text arriving on standard input or a FIFO is simulated as it is read
+// during the first replay, and spilled as packed chunks for the later
+// ones: to memory, or to `spillFile` when one is named, which is left
+// behind as a packed trace. Nothing is spilled when only one replay is
+// wanted.
+//
+// The filter is applied as the trace comes in: once to a trace held in
+// memory, to every decoded chunk of a packed trace, and to a stream
+// before it is spilled, so replays of the spill need no filtering.
+//
+// Given a block size, the source also coalesces the trace into same-block
+// runs a piece at a time (see BlockRuns.h), once: a trace held in memory
+// when it is loaded, a stream as it arrives, and a packed trace the first
+// time each chunk is decoded. replayRuns hands out the stored runs from
+// then on, and packed chunks that have them are not decoded again.
+class TraceSource
+{
+private:
+    // Addresses of a trace in memory per piece of runs, one packed chunk
+    static constexpr std::size_t kRunPieceRecords = binary_trace::kPackedChunkRecords;
+
+    // Runs of one piece, empty where it has too few to be worth it
+    struct PieceRuns
+    {
+        BlockRuns runs;
+        std::size_t accesses = 0;       // kept by the filter
+        FilterPass::Position after{};   // of a packed chunk's filter pass
+    };
+
+    Trace trace;
+    std::vector<char> packedBytes; // a packed trace read whole from a stream
+    TraceFilter filter;
+    int runBlockSize;
+    std::vector<PieceRuns> memoryRuns; // per kRunPieceRecords of `trace`
+
+    // The stream is consumed by the first replay, which is why these change
+    // under a const replay; a spill file is mapped as `packed` afterwards
+    mutable std::unique_ptr<MappedFile> packed;
+    mutable std::unique_ptr<TraceStream> stream;
+    mutable std::vector<char> spill;
+    mutable bool packedFiltered = false;
+    mutable std::vector<PieceRuns> chunkRuns; // per packed chunk replayed so far
+    std::string spillFile;
+    bool keepSpill;
+
+public:
+    explicit TraceSource(const std::string &fileName, const std::string &spillFile = "", unsigned passes = 2, const TraceFilter &filter = TraceFilter(),
+                         int runBlockSize = 0)
+        : filter(filter), runBlockSize(runBlockSize), spillFile(spillFile), keepSpill(passes > 1)
+    {
+        if (isStreamInput(fileName))
+        {
+            auto input = std::make_unique<TraceStream>(fileName);
+            if (!input->binary())
+            {
+                stream = std::move(input);
+                return;
+            }
+
+            // Binary traces are compact already: keep them as they came
+            std::vector<char> bytes = input->readAll();
+            if (binary_trace::readHeader(bytes.data(), bytes.size()).encoding == binary_trace::kEncodingDeltaVarint)
+            {
+                PackedTraceDecoder check(bytes.data(), bytes.size());
+                packedBytes = std::move(bytes);
+            }
+            else
+            {
+                parseBinaryTrace(bytes.data(), bytes.size(), trace);
+                loaded();
+            }
+            return;
+        }
+
+        auto file = std::make_unique<MappedFile>(fileName);
+        if (binary_trace::isBinary(file->data(), file->size()) &&
+            binary_trace::readHeader(file->data(), file->size()).encoding == binary_trace::kEncodingDeltaVarint)
+        {
+            // Validate the header now rather than on the first replay
+            PackedTraceDecoder check(file->data(), file->size());
+            packed = std::move(file);
+        }
+        else
+        {
+            file.reset();
+            trace = loadTrace(fileName);
+            loaded();
+        }
+    }
+
+    // Calls fn(addresses, count) for consecutive, non-empty pieces of the
+    // filtered trace until the trace ends or fn returns false
+    template <typename Fn>
+    void replay(Fn &&fn) const
+    {
+        if (stream)
+        {
+            replayStream(fn);
+            return;
+        }
+
+        const std::vector<char> &owned = spill.empty() ? packedBytes : spill;
+        if (!packed && owned.empty())
+        {
+            if (trace.size() > 0)
+                fn(trace.data(), trace.size());
+            return;
+        }
+
+        const bool filtering = filteringPacked();
+        FilterPass pass(filter);
+        PackedTraceDecoder decoder = packedDecoder();
+        std::vector<Address> chunk;
+        std::vector<Address> kept;
+        while (decoder.next(chunk))
+        {
+            if (filtering)
+                pass.apply(chunk.data(), chunk.size(), kept);
+            const std::vector<Address> &piece = filtering ? kept : chunk;
+            if (!piece.empty() && !fn(static_cast<const Address *>(piece.data()), piece.size()))
+                return;
+            if (filtering && pass.done())
+                return;
+        }
+    }
+
+    // Like replay, with the same-block runs for the block size given at
+    // construction: fn(addresses, count, runs) gets a piece's runs where
+    // it has them, and then no addresses, or else its addresses and a null
+    // runs
+    template <typename Fn>
+    void replayRuns(Fn &&fn) const
+    {
+        if (runBlockSize <= 0)
+        {
+            replay([&](const Address *addresses, std::size_t count)
+                   { return fn(addresses, count, static_cast<const BlockRuns *>(nullptr)); });
+            return;
+        }
+
+        if (stream)
+        {
+            // Runs are kept for the spill's chunks only when there is a spill
+            replayStream([&](const Address *addresses, std::size_t count)
+                         {
+                bool more = fn(addresses, count, coalesceChunk(addresses, count, FilterPass::Position{}));
+                if (!keepSpill)
+                    chunkRuns.clear();
+                return more; });
+            return;
+        }
+
+        const std::vector<char> &owned = spill.empty() ? packedBytes : spill;
+        if (!packed && owned.empty())
+        {
+            for (std::size_t k = 0; k < memoryRuns.size(); ++k)
+            {
+                const PieceRuns &piece = memoryRuns[k];
+                const BlockRuns *runs = piece.runs.size() > 0 ? &piece.runs : nullptr;
+                if (!fn(runs != nullptr ? nullptr : trace.data() + k * kRunPieceRecords, piece.accesses, runs))
+                    return;
+            }
+            return;
+        }
+
+        const bool filtering = filteringPacked();
+        FilterPass pass(filter);
+        PackedTraceDecoder decoder = packedDecoder();
+        std::vector<Address> chunk;
+        std::vector<Address> kept;
+        for (std::size_t k = 0;; ++k)
+        {
+            const BlockRuns *runs = nullptr;
+            const Address *addresses = nullptr;
+            std::size_t count = 0;
+            if (k < chunkRuns.size() && chunkRuns[k].runs.size() > 0)
+            {
+                // Coalesced on an earlier replay: the runs are all it takes
+                if (!decoder.skip())
+                    return;
+                pass.seek(chunkRuns[k].after);
+                runs = &chunkRuns[k].runs;
+                count = chunkRuns[k].accesses;
+            }
+            else
+            {
+                if (!decoder.next(chunk))
+                    return;
+                if (filtering)
+                    pass.apply(chunk.data(), chunk.size(), kept);
+                const std::vector<Address> &piece = filtering ? kept : chunk;
+                addresses = piece.data();
+                count = piece.size();
+                if (k == chunkRuns.size())
+                    runs = coalesceChunk(addresses, count, pass.position());
+                if (runs != nullptr)
+                    addresses = nullptr;
+            }
+
+            if (count > 0 && !fn(addresses, count, runs))
+                return;
+            if (filtering && pass.done())
+                return;
+        }
+    }
+
+private:
+    // Filters a trace just loaded into memory and coalesces its pieces
+    void loaded()
+    {
+        applyFilter(filter, trace);
+        if (runBlockSize <= 0)
+            return;
+        for (std::size_t first = 0; first < trace.size(); first += kRunPieceRecords)
+        {
+            memoryRuns.emplace_back();
+            memoryRuns.back().accesses = std::min(kRunPieceRecords, trace.size() - first);
+            coalesceRuns(trace.data() + first, memoryRuns.back().accesses, runBlockSize, memoryRuns.back().runs);
+        }
+    }
+
+    // Stores the runs of the next packed chunk, filtered down to `count`
+    // addresses, and returns them, or null when it has too few
+    const BlockRuns *coalesceChunk(const Address *addresses, std::size_t count, const FilterPass::Position &after) const
+    {
+        chunkRuns.emplace_back();
+        PieceRuns &piece = chunkRuns.back();
+        piece.accesses = count;
+        piece.after = after;
+        return coalesceRuns(addresses, count, runBlockSize, piece.runs) ? &piece.runs : nullptr;
+    }
+
+    // Whether replays of the packed trace still need the filter; a spill
+    // holds the trace as filtered on its way in
+    bool filteringPacked() const
+    {
+        return filter.active() && !(packed ? packedFiltered : !spill.empty());
+    }
+
+    PackedTraceDecoder packedDecoder() const
+    {
+        const std::vector<char> &owned = spill.empty() ? packedBytes : spill;
+        return packed ? PackedTraceDecoder(packed->data(), packed->size()) : PackedTraceDecoder(owned.data(), owned.size());
+    }
+
+    // First replay of a streamed text trace: filters each block as it
+    // arrives, appends it to the spill and simulates it, one packed chunk
+    // of it at a time so later replays see the same pieces
+    template <typename Fn>
+    void replayStream(Fn &&fn) const
+    {
+        using namespace binary_trace;
+        Header header;
+        header.encoding = kEncodingDeltaVarint;
+
+        spill.assign(kHeaderBytes, 0);
+        std::ofstream spillOut;
+        if (keepSpill && !spillFile.empty())
+        {
+            spillOut.open(spillFile, std::ios::binary);
+            if (!spillOut.is_open())
+                throw TraceError("Unable to create file " + spillFile);
+            spillOut.write(spill.data(), kHeaderBytes);
+        }
+
+        FilterPass pass(filter);
+        Trace block;
+        std::vector<Address> raw;
+        bool stopped = false;
+        while (!stopped && !pass.done() && stream->next(raw))
+        {
+            if (filter.active())
+                pass.apply(raw.data(), raw.size(), block.addresses);
+            else
+                block.addresses.swap(raw);
+
+            for (std::size_t first = 0; first < block.size() && !stopped; first += kPackedChunkRecords)
+            {
+                std::size_t count = std::min(kPackedChunkRecords, block.size() - first);
+                if (keepSpill)
+                {
+                    encodePackedChunks(block, first, count, spill);
+                    header.count += count;
+                    if (spillOut.is_open())
+                    {
+                        // Only the header stays in memory
+                        spillOut.write(spill.data() + kHeaderBytes, static_cast<std::streamsize>(spill.size() - kHeaderBytes));
+                        spill.resize(kHeaderBytes);
+                    }
+                }
+                stopped = !fn(static_cast<const Address *>(block.data() + first), count);
+            }
+        }
+        stream.reset();
+
+        writeHeader(spill.data(), header);
+        if (!spillOut.is_open())
+        {
+            if (!keepSpill)
+                spill.clear();
+            return;
+        }
+
+        spillOut.seekp(0);
+        spillOut.write(spill.data(), kHeaderBytes);
+        spillOut.close();
+        if (!spillOut)
+            throw TraceError("Unable to write file " + spillFile);
+        spill.clear();
+        packed = std::make_unique<MappedFile>(spillFile);
+        packedFiltered = true;
+    }
+};
+
+#endif